@@ -25,12 +25,15 @@
 #ifndef _OPENCOG_COVER_TREE_POINT_H
 #define _OPENCOG_COVER_TREE_POINT_H
 
+#include <cmath>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <opencog/util/numeric.h>
 
 #include <opencog/atomspace/AtomSpace.h>
-#include <opencog/dimensional-embedding/DimEmbedModule.h>
+#include <opencog/dimensional-embedding/DistanceKernels.h>
+#include <opencog/dimensional-embedding/EmbeddingStore.h>
 
 /**
  * The CoverTreePoint class and its methods are required by the cover tree
@@ -38,61 +41,113 @@
  */
 namespace opencog {
 
-class CoverTreePoint {
+/**
+ * Euclidean distance, computed on the stored (possibly compact) form.
+ */
+struct EuclideanMetric {
+    static double distance(const EmbedSpan& a, const EmbedSpan& b) {
+        return sqrt(squared_distance(a, b));
+    }
+    static double distance(const EmbeddingStore& store,
+                           EmbeddingStore::Row a, EmbeddingStore::Row b) {
+        return sqrt(store.squaredDistance(a, b));
+    }
+    static double squaredDistanceBounded(const EmbedSpan& a,
+                                         const EmbedSpan& b, double bound) {
+        return squared_distance_bounded(a, b, bound);
+    }
+};
+
+/**
+ * A point of a cover tree over an EmbeddingStore. Points in the tree refer
+ * to their row of the store instead of holding a copy of it, so the
+ * coordinates are only stored once; the row must not change while its
+ * point is in a tree (remove the point, update the row, insert it again).
+ * Query points can also wrap any EmbedSpan, which costs no allocation.
+ *
+ * The Metric policy supplies the distance, between two spans and between
+ * two rows of one store, and a squared distance that may stop summing once
+ * past a bound (see EuclideanMetric).
+ */
+template<typename Metric>
+class CoverTreePointT {
  private:
-    Handle _handle;
-    std::vector<double> _vector;
+    const EmbeddingStore* _store;
+    EmbeddingStore::Row _row;
+    EmbedSpan _span; //only for query points, which have no store
 
- public:    
- CoverTreePoint(const Handle& handle, const std::vector<double>& vector) : _handle(handle), _vector(vector) {}
-    
-    double distance(const CoverTreePoint& p) const;
-    void print(AtomSpace& atomspace);
-    
-    const std::vector<double>& getVector() const {
-        return _vector;
+ public:
+ CoverTreePointT(const EmbeddingStore& store, EmbeddingStore::Row row)
+     : _store(&store), _row(row) {}
+ explicit CoverTreePointT(const EmbedSpan& span)
+     : _store(0), _row(EmbeddingStore::npos), _span(span) {}
+
+    double distance(const CoverTreePointT& p) const {
+        //Rows of one store use the kernels picked for its row length
+        if (_store && _store == p._store)
+            return Metric::distance(*_store, _row, p._row);
+        return Metric::distance(getVector(), p.getVector());
+    }
+    /**
+     * Whether p is certainly farther than bound, decided from as few of
+     * the coordinates as it takes. Searches call it before distance() on
+     * points they can discard; it never rules out a point that distance()
+     * puts within bound (or tied with it), and answers false straight away
+     * for rows too short to stop early on.
+     */
+    bool fartherThan(const CoverTreePointT& p, double bound) const {
+        EmbedSpan a = getVector(), b = p.getVector();
+        if (a.size() <= DISTANCE_BOUND_BLOCK || !(bound < INFINITY))
+            return false;
+        //Slack for the compact kernels' rounding, which differs between
+        //the bounded sum and the one distance() makes
+        double limit = bound * bound * (1 + 1e-4) + 1e-12;
+        return Metric::squaredDistanceBounded(a, b, limit) > limit;
+    }
+    void print(AtomSpace& atomspace) const;
+
+    EmbedSpan getVector() const {
+        return _store ? _store->getRow(_row) : _span;
     }
     const Handle& getHandle() const {
-        return _handle;
+        return _store ? _store->getHandle(_row) : Handle::UNDEFINED;
+    }
+    EmbeddingStore::Row getRow() const {
+        return _row;
+    }
+    /**
+     * The store the point is a row of (0 for a query point of its own).
+     */
+    const EmbeddingStore* getStore() const {
+        return _store;
     }
 
-    bool operator==(const CoverTreePoint& p) const {
-        return (_handle==p.getHandle() && this->distance(p)==0.0);
-    } 
+    bool operator==(const CoverTreePointT& p) const {
+        if (_store && p._store)
+            return _store==p._store && _row==p._row;
+        return (getHandle()==p.getHandle() && this->distance(p)==0.0);
+    }
 };
 
- void CoverTreePoint::print(AtomSpace& atomspace) {
+typedef CoverTreePointT<EuclideanMetric> CoverTreePoint;
+
+template<typename Metric>
+void CoverTreePointT<Metric>::print(AtomSpace& atomspace) const {
      std::ostringstream oss;
-     if(!atomspace.is_valid_handle(_handle)) {
+     if(!atomspace.is_valid_handle(getHandle())) {
          oss << "[NODE'S BEEN DELETED]" << " : (";
      } else {
-         oss << _handle->to_short_string() << " : (";
+         oss << getHandle()->to_short_string() << " : (";
      }
-     for(std::vector<double>::const_iterator it=_vector.begin();
-         it!=_vector.end(); ++it)
+     EmbedSpan v = getVector();
+     for(size_t i=0; i<v.size(); ++i)
          {
-             oss << *it << " ";
-         }       
+             oss << v[i] << " ";
+         }
      oss << ")" << std::endl;
      printf("%s", oss.str().c_str());
 }
- 
- double CoverTreePoint::distance(const CoverTreePoint& p) const {
-     const std::vector<double>& v=p.getVector();
-     OC_ASSERT(_vector.size()==v.size());
-     std::vector<double>::const_iterator it1=_vector.begin();
-     std::vector<double>::const_iterator it2=v.begin();
-     
-     double distance=0;
-     //Calculate euclidean distance between v1 and v2
-     for(; it1!=_vector.end(); it1++, it2++) {
-         distance += sq(*it1 - *it2);
-     }
-     
-     distance=sqrt(distance);
-     return distance;
- }
- 
+
 }//namespace
 
 #endif //_OPENCOG_COVER_TREE_POINT_H
@@ -22,7 +22,9 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <exception>
 #include <functional>
 #include <limits>
 #include <numeric>
@@ -38,11 +40,11 @@
 #include <opencog/util/Logger.h>
 #include <opencog/util/mt19937ar.h>
 
-extern "C" {
-#include <opencog/util/cluster.h>
-}
-
 #include "DimEmbedModule.h"
+#include "DistanceKernels.h"
+#include "IvfIndex.h"
+#include "KMeans.h"
+#include "WidestPath.h"
 
 using namespace opencog;
 using namespace std::placeholders;
@@ -52,7 +54,11 @@ typedef std::vector<std::pair<HandleSeq,std::vector<double> > >
 
 DECLARE_MODULE(DimEmbedModule)
 
-DimEmbedModule::DimEmbedModule(CogServer& cs) : Module(cs)
+const size_t DimEmbedModule::KNN_CACHE_BYTES;
+
+DimEmbedModule::DimEmbedModule(CogServer& cs)
+    : Module(cs), _numThreads(0), _knnCache(KNN_CACHE_BYTES), _batchDepth(0),
+      _applyingBatch(false)
 {
     logger().info("[DimEmbedModule] constructor");
     as = &_cogserver.getAtomSpace();
@@ -87,7 +93,11 @@ void DimEmbedModule::init()
 #ifdef HAVE_GUILE
     //Functions available to scheme shell
     define_scheme_primitive("embedSpace",
-                            &DimEmbedModule::embedAtomSpace,
+                            static_cast<void (DimEmbedModule::*)(Type, int)>
+                                (&DimEmbedModule::embedAtomSpace),
+                            this);
+    define_scheme_primitive("embedSpaceBatched",
+                            &DimEmbedModule::embedAtomSpaceBatched,
                             this);
     define_scheme_primitive("logEmbedding",
                             &DimEmbedModule::logAtomEmbedding,
@@ -98,15 +108,79 @@ void DimEmbedModule::init()
     define_scheme_primitive("kNN",
                             &DimEmbedModule::kNearestNeighbors,
                             this);
+    define_scheme_primitive("kNNFiltered",
+                            &DimEmbedModule::kNNFiltered,
+                            this);
+    define_scheme_primitive("kNNBatch",
+                            &DimEmbedModule::kNNBatchLinks,
+                            this);
+    define_scheme_primitive("kNNVector",
+                            &DimEmbedModule::kNNVector,
+                            this);
+    define_scheme_primitive("kNNVectorBatch",
+                            &DimEmbedModule::kNNVectorBatch,
+                            this);
+    define_scheme_primitive("radiusNN",
+                            &DimEmbedModule::withinRadius,
+                            this);
+    define_scheme_primitive("kNNIndexFlat",
+                            &DimEmbedModule::useFlatIndex,
+                            this);
+    define_scheme_primitive("kNNIndexHNSW",
+                            &DimEmbedModule::useHnswIndex,
+                            this);
+    define_scheme_primitive("kNNIndexIVF",
+                            &DimEmbedModule::useIvfIndex,
+                            this);
+    define_scheme_primitive("kNNReindex",
+                            &DimEmbedModule::rebuildIndex,
+                            this);
+    define_scheme_primitive("kNNRecall",
+                            &DimEmbedModule::measureRecall,
+                            this);
     define_scheme_primitive("kMeansCluster",
                             &DimEmbedModule::addKMeansClusters,
                             this);
+    define_scheme_primitive("kMeansMiniBatch",
+                            &DimEmbedModule::useMiniBatchKMeans,
+                            this);
 #endif
 }
 
-const std::vector<double>& DimEmbedModule::getEmbedVector(Handle h,
-                                                          Type l,
-                                                          bool fanin) const
+void DimEmbedModule::setNumThreads(unsigned numThreads)
+{
+    _numThreads = numThreads;
+    _pool.reset();
+}
+
+ThreadPool& DimEmbedModule::getThreadPool()
+{
+    if (!_pool) _pool.reset(new ThreadPool(_numThreads));
+    return *_pool;
+}
+
+DimEmbedModule::AtomEmbedding& DimEmbedModule::getAtomEmbedding(Type l,
+                                                                bool fanin)
+{
+    return const_cast<AtomEmbedding&>(
+        static_cast<const DimEmbedModule*>(this)->getAtomEmbedding(l, fanin));
+}
+
+const DimEmbedModule::AtomEmbedding&
+DimEmbedModule::getAtomEmbedding(Type l, bool fanin) const
+{
+    bool symmetric = nameserver().isA(l,UNORDERED_LINK);
+    if (symmetric) {
+        AtomEmbedMap::const_iterator it = atomMaps.find(l);
+        OC_ASSERT(it!=atomMaps.end());
+        return it->second;
+    }
+    AsymAtomEmbedMap::const_iterator it = asymAtomMaps.find(l);
+    OC_ASSERT(it!=asymAtomMaps.end());
+    return fanin ? it->second.second : it->second.first;
+}
+
+EmbedSpan DimEmbedModule::getEmbedVector(Handle h, Type l, bool fanin) const
 {
     if (!nameserver().isLink(l))
         throw InvalidParamException(TRACE_INFO,
@@ -119,25 +193,13 @@ const std::vector<double>& DimEmbedModule::getEmbedVector(Handle h,
         throw std::string("No embedding exists for type %s", tName);
     }
 
-    bool symmetric = nameserver().isA(l,UNORDERED_LINK);
-    if (symmetric) {
-        const AtomEmbedding& aE = (atomMaps.find(l))->second;
-        //AtomEmbedding::const_iterator aEit = aE.find(h);
-        //return aEit->second;
-        return aE.find(h)->second;
-    } else {
-        const std::pair<AtomEmbedding, AtomEmbedding>& aEPair =
-            (asymAtomMaps.find(l))->second;
-        if (fanin) {
-            //AtomEmbedding::const_iterator aEit = aEPair.second.find(h);
-            //return aEit->second;
-            return aEPair.second.find(h)->second;
-        } else {
-            //AtomEmbedding::const_iterator aEit = aE.find(h);
-            //return aEit->second;
-            return aEPair.first.find(h)->second;
-        }
-    }
+    const AtomEmbedding& aE = getAtomEmbedding(l, fanin);
+    AtomEmbedding::Row row = aE.find(h);
+    if (row==AtomEmbedding::npos)
+        throw InvalidParamException(TRACE_INFO,
+            "Atom is not part of the %s embedding",
+            nameserver().getTypeName(l).c_str());
+    return aE.getRow(row);
 }
 
 HandleSeq& DimEmbedModule::getPivots(Type l, bool fanin)
@@ -172,182 +234,580 @@ HandleSeq DimEmbedModule::kNearestNeighbors(Handle h, Type l, int k, bool fanin)
         logger().error("No embedding exists for type %s", tName);
         throw std::string("No embedding exists for type %s", tName);
     }
-    bool symmetric = nameserver().isA(l,UNORDERED_LINK);
+    //Symmetric embeddings have one direction, whatever fanin says
+    KnnCache::Key key(h, l, fanin && !nameserver().isA(l,UNORDERED_LINK), k);
+    HandleSeq results;
+    if (_knnCache.find(key, results)) return results;
+    const AtomEmbedding& aE = getAtomEmbedding(l, fanin);
+    getEmbedVector(h, l, fanin); //Checks that h is embedded
+    AtomEmbedding::Row row = aE.find(h);
+    CoverTreePoint query(aE, row);
+    int fetch = fetchCount(aE, k);
+    std::vector<AtomEmbedding::Row> rows =
+        getIndex(l, fanin).kNearest(query, fetch);
+    results = rankNeighbors(aE, row, rows, k);
+
+    //Only a point moving within the farthest candidate can change the
+    //answer, or any point at all if there were fewer than asked for
+    double radius = std::numeric_limits<double>::infinity();
+    if ((int) rows.size()>=fetch) {
+        radius = 0;
+        for (AtomEmbedding::Row r : rows)
+            radius = std::max(radius, query.distance(CoverTreePoint(aE, r)));
+    }
+    _knnCache.insert(key, results, aE.getRow(row), radius);
+    return results;
+}
 
-    std::vector<CoverTreePoint> points;
-    if (symmetric) {
-        EmbedTreeMap::const_iterator it = embedTreeMap.find(l);
-        points =
-            it->second.k_nearest_neighbors(CoverTreePoint(h,atomMaps[l][h]),k);
-    } else {
-        AsymEmbedTreeMap::const_iterator it = asymEmbedTreeMap.find(l);
-        if (fanin) {
-            points =
-                it->second.second.
-                k_nearest_neighbors(CoverTreePoint(h,asymAtomMaps[l].second[h]),k);
-        }
-        else {
-            points =
-                it->second.first.
-                k_nearest_neighbors(CoverTreePoint(h,asymAtomMaps[l].first[h]),k);
+HandleSeq DimEmbedModule::kNearestNeighborsFiltered(
+    Handle h, Type l, int k, const NeighborFilter& filter, bool fanin)
+{
+    getEmbedVector(h, l, fanin); //Checks that h is embedded
+    const AtomEmbedding& aE = getAtomEmbedding(l, fanin);
+    //The rows of the wanted types, in one bitmap
+    RowSet ofType;
+    typedef std::map<Type, RowSet>::const_iterator TypeRowsIt;
+    for (TypeRowsIt it = aE.getTypeRows().begin();
+         it != aE.getTypeRows().end(); ++it) {
+        for (Type t : filter.types) {
+            if (nameserver().isA(it->first, t)) {
+                ofType |= it->second;
+                break;
+            }
         }
     }
-    HandleSeq results;
-    std::vector<CoverTreePoint>::const_iterator it;
-    for (it=points.begin(); it!=points.end(); ++it) {
-        results.push_back(it->getHandle());
+    EmbedIndex::RowFilter accept = [&](AtomEmbedding::Row r) {
+        return (filter.types.empty() || ofType.contains(r)) &&
+               (!filter.predicate || filter.predicate(aE.getHandle(r)));
+    };
+    AtomEmbedding::Row row = aE.find(h);
+    std::vector<AtomEmbedding::Row> rows =
+        getIndex(l, fanin).kNearest(CoverTreePoint(aE, row),
+                                    fetchCount(aE, k), accept);
+    return rankNeighbors(aE, row, rows, k);
+}
+
+HandleSeq DimEmbedModule::kNNFiltered(Handle h, Type l, int k, Type nodeType,
+                                      double minSTI, bool fanin)
+{
+    NeighborFilter filter;
+    filter.types.push_back(nodeType);
+    filter.predicate = [&](const Handle& n) {
+        return _bank->get_sti(n) >= minSTI;
+    };
+    return kNearestNeighborsFiltered(h, l, k, filter, fanin);
+}
+
+std::vector<HandleSeq> DimEmbedModule::kNearestNeighborsBatch(
+    const HandleSeq& hs, Type l, int k, bool fanin)
+{
+    if (!nameserver().isLink(l))
+        throw InvalidParamException(TRACE_INFO,
+            "DimensionalEmbedding requires link type, not %s",
+            nameserver().getTypeName(l).c_str());
+    if (!isEmbedded(l)) {
+        const char* tName = nameserver().getTypeName(l).c_str();
+        logger().error("No embedding exists for type %s", tName);
+        throw std::string("No embedding exists for type %s", tName);
     }
+    const AtomEmbedding& aE = getAtomEmbedding(l, fanin);
+    std::vector<AtomEmbedding::Row> queryRows;
+    std::vector<CoverTreePoint> queries;
+    for (const Handle& h : hs) {
+        AtomEmbedding::Row row = aE.find(h);
+        if (row==AtomEmbedding::npos)
+            throw InvalidParamException(TRACE_INFO,
+                "Atom is not part of the %s embedding",
+                nameserver().getTypeName(l).c_str());
+        queryRows.push_back(row);
+        queries.push_back(CoverTreePoint(aE, row));
+    }
+    std::vector<std::vector<AtomEmbedding::Row> > rows =
+        getIndex(l, fanin).kNearestBatch(queries, fetchCount(aE, k),
+                                         &getThreadPool());
+    std::vector<HandleSeq> results(hs.size());
+    for (size_t i=0; i<hs.size(); ++i)
+        results[i] = rankNeighbors(aE, queryRows[i], rows[i], k);
     return results;
 }
 
-static bool is_source(const Handle& source, const Handle& link)
+HandleSeq DimEmbedModule::kNNBatchLinks(const HandleSeq& hs, Type l, int k,
+                                        bool fanin)
 {
-    LinkPtr lptr(LinkCast(link));
-    // On ordered links, only the first position in the outgoing set
-    // is a source of this link. So, if the handle given is equal to
-    // the first position, true is returned.
-    Arity arity = lptr->get_arity();
-    if (nameserver().isA(lptr->get_type(), ORDERED_LINK)) {
-        return arity > 0 and lptr->getOutgoingAtom(0) == source;
-    } else if (nameserver().isA(lptr->get_type(), UNORDERED_LINK)) {
-        // If the link is unordered, the outgoing set is scanned;
-        // return true if any position is equal to the source.
-        for (const Handle& h : lptr->getOutgoingSet())
-            if (h == source) return true;
-        return false;
-    }
-    return false;
+    std::vector<HandleSeq> nns = kNearestNeighborsBatch(hs, l, k, fanin);
+    HandleSeq lists;
+    for (const HandleSeq& nn : nns)
+        lists.push_back(as->add_link(LIST_LINK, nn));
+    return lists;
 }
 
-void DimEmbedModule::addPivot(Handle h, Type linkType, bool fanin)
+void DimEmbedModule::forEachWithinRadius(Handle h, Type l, double r,
+                                         const RadiusVisitor& visit,
+                                         bool fanin)
 {
-    if (!nameserver().isLink(linkType))
+    getEmbedVector(h, l, fanin); //Checks that h is embedded
+    const AtomEmbedding& aE = getAtomEmbedding(l, fanin);
+    getIndex(l, fanin).withinRadius(CoverTreePoint(aE, aE.find(h)), r,
+        [&](AtomEmbedding::Row row, double d) {
+            return visit(aE.getHandle(row), d);
+        });
+}
+
+const DimEmbedModule::AtomEmbedding&
+DimEmbedModule::getQueryEmbedding(Type l, size_t dims, bool fanin) const
+{
+    if (!nameserver().isLink(l))
         throw InvalidParamException(TRACE_INFO,
             "DimensionalEmbedding requires link type, not %s",
-            nameserver().getTypeName(linkType).c_str());
-    bool symmetric = nameserver().isA(linkType,UNORDERED_LINK);
-    if (!fanin) _bank->inc_vlti(h); //We don't want pivot atoms to be forgotten...
+            nameserver().getTypeName(l).c_str());
+    if (!isEmbedded(l)) {
+        const char* tName = nameserver().getTypeName(l).c_str();
+        logger().error("No embedding exists for type %s", tName);
+        throw std::string("No embedding exists for type %s", tName);
+    }
+    const AtomEmbedding& aE = getAtomEmbedding(l, fanin);
+    if (dims!=aE.getDimensions())
+        throw InvalidParamException(TRACE_INFO,
+            "The %s embedding has %d dimensions, not %d",
+            nameserver().getTypeName(l).c_str(),
+            (int) aE.getDimensions(), (int) dims);
+    return aE;
+}
+
+std::vector<double> DimEmbedModule::getNumberVector(Handle v) const
+{
+    if (!LinkCast(v))
+        throw InvalidParamException(TRACE_INFO,
+            "A vector is given as a link of NumberNodes");
+    std::vector<double> coords;
+    for (const Handle& n : LinkCast(v)->getOutgoingSet()) {
+        if (n->get_type()!=NUMBER_NODE)
+            throw InvalidParamException(TRACE_INFO,
+                "A vector is given as a link of NumberNodes");
+        coords.push_back(std::stod(NodeCast(n)->get_name()));
+    }
+    return coords;
+}
+
+HandleSeq DimEmbedModule::kNearestToVector(const std::vector<double>& v,
+                                           Type l, int k, bool fanin)
+{
+    const AtomEmbedding& aE = getQueryEmbedding(l, v.size(), fanin);
+    EmbedSpan query(v);
+    std::vector<AtomEmbedding::Row> rows =
+        getIndex(l, fanin).kNearest(CoverTreePoint(query), fetchCount(aE, k));
+    return rankNeighbors(aE, query, rows, k);
+}
+
+std::vector<HandleSeq> DimEmbedModule::kNearestToVectors(
+    const std::vector<std::vector<double> >& vs, Type l, int k, bool fanin)
+{
+    std::vector<HandleSeq> results(vs.size());
+    if (vs.empty()) return results;
+    std::vector<CoverTreePoint> queries;
+    for (const std::vector<double>& v : vs) {
+        getQueryEmbedding(l, v.size(), fanin); //Checks each size
+        queries.push_back(CoverTreePoint(EmbedSpan(v)));
+    }
+    const AtomEmbedding& aE = getAtomEmbedding(l, fanin);
+    std::vector<std::vector<AtomEmbedding::Row> > rows =
+        getIndex(l, fanin).kNearestBatch(queries, fetchCount(aE, k),
+                                         &getThreadPool());
+    for (size_t i=0; i<vs.size(); ++i)
+        results[i] = rankNeighbors(aE, EmbedSpan(vs[i]), rows[i], k);
+    return results;
+}
+
+HandleSeq DimEmbedModule::kNNVector(Handle v, Type l, int k, bool fanin)
+{
+    return kNearestToVector(getNumberVector(v), l, k, fanin);
+}
+
+HandleSeq DimEmbedModule::kNNVectorBatch(const HandleSeq& vs, Type l, int k,
+                                         bool fanin)
+{
+    std::vector<std::vector<double> > points;
+    for (const Handle& v : vs) points.push_back(getNumberVector(v));
+    std::vector<HandleSeq> nns = kNearestToVectors(points, l, k, fanin);
+    HandleSeq lists;
+    for (const HandleSeq& nn : nns)
+        lists.push_back(as->add_link(LIST_LINK, nn));
+    return lists;
+}
+
+void DimEmbedModule::forEachWithinRadius(const std::vector<double>& v,
+                                         Type l, double r,
+                                         const RadiusVisitor& visit,
+                                         bool fanin)
+{
+    const AtomEmbedding& aE = getQueryEmbedding(l, v.size(), fanin);
+    getIndex(l, fanin).withinRadius(CoverTreePoint(EmbedSpan(v)), r,
+        [&](AtomEmbedding::Row row, double d) {
+            return visit(aE.getHandle(row), d);
+        });
+}
+
+HandleSeq DimEmbedModule::withinRadius(Handle h, Type l, double r, bool fanin)
+{
+    std::vector<std::pair<double, Handle> > found;
+    forEachWithinRadius(h, l, r,
+        [&](const Handle& n, double d) {
+            found.push_back(std::make_pair(d, n));
+            return true;
+        }, fanin);
+    std::sort(found.begin(), found.end());
+    HandleSeq results;
+    for (const std::pair<double, Handle>& f : found)
+        results.push_back(f.second);
+    return results;
+}
+
+DimEmbedModule::NodeCursor DimEmbedModule::neighborCursor(Handle h, Type l,
+                                                          bool fanin)
+{
+    getEmbedVector(h, l, fanin); //Checks that h is embedded
+    const AtomEmbedding& aE = getAtomEmbedding(l, fanin);
+    const EmbedIndexPtr& index = getIndexPtr(l, fanin);
+    NodeCursor cursor;
+    cursor._index = index;
+    cursor._cursor.reset(
+        index->neighbors(CoverTreePoint(aE, aE.find(h))).release());
+    return cursor;
+}
+
+bool DimEmbedModule::NodeCursor::isStale() const
+{
+    return _index.expired() || _cursor->isStale();
+}
+
+bool DimEmbedModule::NodeCursor::next(Handle& h, double& d)
+{
+    if (isStale()) {
+        logger().error("The embedding changed since the cursor was made");
+        throw std::string("The embedding changed since the cursor was made");
+    }
+    AtomEmbedding::Row row;
+    if (!_cursor->next(row, d)) return false;
+    h = _index.lock()->getStore().getHandle(row);
+    return true;
+}
+
+HandleSeq DimEmbedModule::NodeCursor::next(int n)
+{
     HandleSeq nodes;
-    as->get_handles_by_type(std::back_inserter(nodes), NODE, true);
+    Handle h;
+    double d;
+    while ((int) nodes.size() < n && next(h, d)) nodes.push_back(h);
+    return nodes;
+}
 
-    std::map<Handle, double> distMap;
+int DimEmbedModule::fetchCount(const AtomEmbedding& aE, int k) const
+{
+    if (k<0)
+        throw InvalidParamException(TRACE_INFO,
+            "Cannot find %d nearest neighbours", k);
+    if (k==0) return 0;
+    //A compact embedding that keeps an exact copy is searched for a few
+    //extra candidates, which are then re-ranked on the exact coordinates
+    if (aE.getPrecision()!=EMBED_FLOAT64 && aE.hasExact())
+        return std::max(2*k, k+8);
+    return k;
+}
 
-    typedef std::multimap<double,Handle> pQueue_t;
-    pQueue_t pQueue;
-    for (HandleSeq::iterator it=nodes.begin(); it!=nodes.end(); ++it){
-        if (*it==h) {
-            pQueue.insert(std::pair<double, Handle>(1,*it));
-            distMap[*it]=1;
-        } else {
-            pQueue.insert(std::pair<double, Handle>(0,*it));
-            distMap[*it]=0;
-        }
+HandleSeq DimEmbedModule::rankNeighbors(
+    const AtomEmbedding& aE, AtomEmbedding::Row query,
+    const std::vector<AtomEmbedding::Row>& rows, int k) const
+{
+    bool rerank = aE.getPrecision()!=EMBED_FLOAT64 && aE.hasExact();
+    return rankNeighbors(aE, rerank ? aE.getExactRow(query) : EmbedSpan(),
+                         rows, k);
+}
+
+HandleSeq DimEmbedModule::rankNeighbors(
+    const AtomEmbedding& aE, EmbedSpan exactQuery,
+    const std::vector<AtomEmbedding::Row>& rows, int k) const
+{
+    HandleSeq results;
+    if (aE.getPrecision()==EMBED_FLOAT64 || !aE.hasExact()) {
+        for (AtomEmbedding::Row r : rows) results.push_back(aE.getHandle(r));
+        return results;
     }
-    if (symmetric) {
-        pivotsMap[linkType].push_back(h);
-    } else {
-        if (fanin) asymPivotsMap[linkType].second.push_back(h);
-        else asymPivotsMap[linkType].first.push_back(h);
+
+    std::vector<std::pair<double, Handle> > ranked;
+    for (AtomEmbedding::Row r : rows) {
+        ranked.push_back(std::make_pair(
+            euclidDist(exactQuery, aE.getExactRow(r)), aE.getHandle(r)));
+    }
+    std::stable_sort(ranked.begin(), ranked.end(),
+        [](const std::pair<double, Handle>& a,
+           const std::pair<double, Handle>& b) { return a.first < b.first; });
+    //Keep k, plus any tied with the kth (as the cover tree would)
+    for (size_t i=0; k>0 && i<ranked.size(); ++i) {
+        if ((int) i >= k && ranked[i].first > ranked[k-1].first) break;
+        results.push_back(ranked[i].second);
     }
-    while(!pQueue.empty()) {
-        pQueue_t::reverse_iterator p_it = pQueue.rbegin();
-        Handle u = p_it->second;//extract max (highest weight)
+    return results;
+}
 
-        /*std::cout << "U=" << u << " distmap={";
-        for (std::map<Handle, double>::iterator it = distMap.begin();
-                it != distMap.end(); ++it) {
-            std::cout << it->second << ":h=" << it->first << ",";
-        }
-        std::cout << "}" << std::endl;*/
-
-        //we can't simply erase p_it->first because there could be multiple
-        //nodes that are the same distance from our pivot, and we can't
-        //pass erase p_it because it's a reverseiterator, thus this awkwardness
-        pQueue_t::iterator erase_it = pQueue.end();
-        pQueue.erase(--erase_it);
-
-        if (distMap[u]==0) { break;}
-        HandleSeq newLinks;
-        u->getIncomingSet(back_inserter(newLinks));
-        for (HandleSeq::iterator it=newLinks.begin(); it!=newLinks.end(); ++it){
-            //ignore links that aren't a subtype of linkType
-            if (!nameserver().isA((*it)->get_type(), linkType)) continue;
-            TruthValuePtr linkTV = (*it)->getTruthValue();
-            HandleSeq newNodes = (*it)->getOutgoingSet();
-            HandleSeq::iterator it2=newNodes.begin();
-            //if !fanin, we're following the "outward" links, so it's only a
-            //valid link if u is the source
-            if (!symmetric && !fanin && !is_source(u,*it)) continue;
-            if (!symmetric && fanin) {
-                if (is_source(u,*it)) {
-                    continue;
-                }
-                else {
-                    newNodes.clear();
-                    newNodes.push_back(*it2);
-                    it2=newNodes.begin();
-                }
-            }
-            for (;it2!=newNodes.end(); ++it2) {
-                if (!(*it2)->is_node()) continue;
-                double alt =
-                    distMap[u] * linkTV->get_mean() * linkTV->get_confidence();
-                double oldDist=distMap[*it2];
-                //If we've found a better (higher weight) path, update distMap
-                if (alt>oldDist) {
-                    pQueue_t::iterator it3;
-                    std::pair<pQueue_t::iterator, pQueue_t::iterator>
-                        itPair = pQueue.equal_range(oldDist);
-                    for (it3=itPair.first;it3!=itPair.second;++it3) {
-                        if (it3->second==*it2) {pQueue.erase(it3); break;}
-                    }
-                    pQueue.insert(std::pair<double, Handle>(alt,*it2));
-                    distMap[*it2]=alt;
-                }
-            }
-        }
+void DimEmbedModule::setIndexParams(Type l, const EmbedIndexParams& params)
+{
+    if (!nameserver().isLink(l))
+        throw InvalidParamException(TRACE_INFO,
+            "DimensionalEmbedding requires link type, not %s",
+            nameserver().getTypeName(l).c_str());
+    indexParamsMap[l] = params;
+    if (isEmbedded(l)) buildIndices(l);
+}
+
+void DimEmbedModule::useFlatIndex(Type l)
+{
+    EmbedIndexParams params;
+    params.type = FLAT_INDEX;
+    setIndexParams(l, params);
+}
+
+void DimEmbedModule::useIvfIndex(Type l, int numCells, int nprobe)
+{
+    EmbedIndexParams params;
+    params.type = IVF_INDEX;
+    if (numCells > 0) params.numCells = numCells;
+    if (nprobe > 0) params.nprobe = nprobe;
+    setIndexParams(l, params);
+}
+
+void DimEmbedModule::rebuildIndex(Type l)
+{
+    if (!nameserver().isLink(l))
+        throw InvalidParamException(TRACE_INFO,
+            "DimensionalEmbedding requires link type, not %s",
+            nameserver().getTypeName(l).c_str());
+    if (!isEmbedded(l)) {
+        const char* tName = nameserver().getTypeName(l).c_str();
+        logger().error("No embedding exists for type %s", tName);
+        throw std::string("No embedding exists for type %s", tName);
     }
-    for (std::map<Handle, double>::iterator it = distMap.begin();
-            it != distMap.end(); ++it) {
-        if (symmetric) {
-            atomMaps[linkType][it->first].push_back(it->second);
-        } else {
-            if (fanin) asymAtomMaps[linkType].second[it->first].push_back(it->second);
-            else asymAtomMaps[linkType].first[it->first].push_back(it->second);
-        }
+    buildIndices(l);
+}
+
+void DimEmbedModule::useHnswIndex(Type l, int M, int efConstruction,
+                                  int efSearch)
+{
+    EmbedIndexParams params;
+    params.type = HNSW_INDEX;
+    if (M > 0) params.M = M;
+    if (efConstruction > 0) params.efConstruction = efConstruction;
+    if (efSearch > 0) params.efSearch = efSearch;
+    setIndexParams(l, params);
+}
+
+const EmbedIndexParams& DimEmbedModule::getIndexParams(Type l) const
+{
+    static const EmbedIndexParams defaults;
+    std::map<Type, EmbedIndexParams>::const_iterator it =
+        indexParamsMap.find(l);
+    return it==indexParamsMap.end() ? defaults : it->second;
+}
+
+double DimEmbedModule::measureRecall(Type l, int k, int numQueries,
+                                     bool fanin)
+{
+    if (!nameserver().isLink(l))
+        throw InvalidParamException(TRACE_INFO,
+            "DimensionalEmbedding requires link type, not %s",
+            nameserver().getTypeName(l).c_str());
+    if (!isEmbedded(l)) {
+        const char* tName = nameserver().getTypeName(l).c_str();
+        logger().error("No embedding exists for type %s", tName);
+        throw std::string("No embedding exists for type %s", tName);
     }
+    const AtomEmbedding& aE = getAtomEmbedding(l, fanin);
+    const EmbedIndex& index = getIndex(l, fanin);
+    if (k <= 0 || aE.size()==0) return 1;
+
+    //The true neighbours come from an exact cover tree, made just for
+    //this unless the index is one already
+    EmbedIndexPtr exact;
+    const EmbedIndex* reference = &index;
+    if (!index.isExact()) {
+        exact = make_embed_index(aE, EmbedIndexParams(),
+                                 aE.getDimensions()+.1);
+        exact->build(&getThreadPool());
+        reference = exact.get();
+    }
+
+    //Queries spread evenly over the embedded nodes
+    std::vector<AtomEmbedding::Row> live;
+    for (AtomEmbedding::Row r=0; r<aE.numRows(); ++r)
+        if (aE.isLive(r)) live.push_back(r);
+    size_t n = std::min((size_t) std::max(numQueries, 1), live.size());
+    size_t wanted = std::min((size_t) k, live.size());
+    double hits = 0;
+    std::chrono::duration<double, std::micro> indexTime(0), exactTime(0);
+    for (size_t i=0; i<n; ++i) {
+        CoverTreePoint query(aE, live[i * live.size() / n]);
+        std::chrono::steady_clock::time_point t0 =
+            std::chrono::steady_clock::now();
+        std::vector<AtomEmbedding::Row> found = index.kNearest(query, k);
+        std::chrono::steady_clock::time_point t1 =
+            std::chrono::steady_clock::now();
+        std::vector<AtomEmbedding::Row> truth = reference->kNearest(query, k);
+        exactTime += std::chrono::steady_clock::now() - t1;
+        indexTime += t1 - t0;
+        //Any of the nodes tied for kth place is a right answer
+        std::sort(truth.begin(), truth.end());
+        size_t right = 0;
+        for (AtomEmbedding::Row r : found)
+            if (std::binary_search(truth.begin(), truth.end(), r)) ++right;
+        hits += std::min(right, wanted);
+    }
+    double recall = hits / (n * wanted);
+    logger().info("[DimEmbedModule] %s recall@%d %.4f over %d queries: "
+                  "%.1f us per query, exact %.1f us", index.name(), k,
+                  recall, (int) n, indexTime.count() / n,
+                  exactTime.count() / n);
+    return recall;
 }
 
-Handle DimEmbedModule::pickPivot(Type linkType, HandleSeq& nodes, bool fanin)
+void DimEmbedModule::addPivot(Handle h, Type linkType,
+                              const EmbedGraph& graph, bool fanin)
 {
-    bool symmetric = nameserver().isA(linkType,UNORDERED_LINK);
+    addPivots(HandleSeq(1, h), linkType, graph, fanin);
+}
 
+void DimEmbedModule::addPivots(const HandleSeq& newPivots, Type linkType,
+                               const EmbedGraph& graph, bool fanin,
+                               const EmbedParams& params)
+{
+    if (!nameserver().isLink(linkType))
+        throw InvalidParamException(TRACE_INFO,
+            "DimensionalEmbedding requires link type, not %s",
+            nameserver().getTypeName(linkType).c_str());
+    OC_ASSERT(graph.getLinkType()==linkType);
+    std::vector<size_t> sources(newPivots.size());
+    for (size_t i=0; i<newPivots.size(); ++i) {
+        if (!graph.getIndex(newPivots[i], sources[i]))
+            throw InvalidParamException(TRACE_INFO,
+                "Pivot must be a node of the embedded graph");
+    }
+
+    const CSRAdjacency& adj = graph.getAdjacency(fanin);
+    std::vector<std::vector<double> > columns(newPivots.size());
+    if (params.parallelSearch) {
+        //One pivot at a time, each search spread over the pool...
+        DeltaSteppingSearch search(params.searchDelta);
+        for (size_t i=0; i<newPivots.size(); ++i)
+            columns[i] = search.run(adj, sources[i], getThreadPool());
+    } else {
+        //...or every pivot at once, each on its own search object...
+        getThreadPool().parallelFor(newPivots.size(), [&](size_t i) {
+            WidestPathSearch search;
+            columns[i] = search.run(adj, sources[i]);
+        });
+    }
+    //...then append the columns in pivot order, so the embedding does not
+    //depend on which search finished first.
+    for (size_t i=0; i<newPivots.size(); ++i)
+        commitPivot(newPivots[i], linkType, graph, columns[i], fanin);
+}
+
+void DimEmbedModule::commitPivot(Handle h, Type linkType,
+                                 const EmbedGraph& graph,
+                                 const std::vector<double>& weights,
+                                 bool fanin)
+{
+    if (!fanin) _bank->inc_vlti(h); //We don't want pivot atoms to be forgotten...
+
+    HandleSeq& pivots = graph.isSymmetric() ? pivotsMap[linkType] :
+        (fanin ? asymPivotsMap[linkType].second : asymPivotsMap[linkType].first);
+    size_t column = pivots.size();
+    pivots.push_back(h);
+
+    //The rows of a fresh embedding are the nodes of graph, in order
+    AtomEmbedding& aE = getAtomEmbedding(linkType, fanin);
+    OC_ASSERT(column < aE.getDimensions() && aE.numRows()==graph.numNodes());
+    aE.setColumn(column, weights);
+}
+
+HandleSeq DimEmbedModule::pickPivots(Type linkType, const HandleSeq& nodes,
+                                     size_t count, bool fanin)
+{
     HandleSeq& pivots = getPivots(linkType,fanin);
-    Handle bestChoice = nodes.back();
-    if (pivots.empty()) return bestChoice;
+    if (pivots.empty()) return HandleSeq(1, nodes.back());
     logger().info("Pivot %d picked", pivots.size());
-    double bestChoiceWeight = 1;
-    //pick the next pivot to maximize its distance from its closest pivot
-    //(maximizing distance = minimizing path weight)
-    for (HandleSeq::iterator it=nodes.begin(); it!=nodes.end(); ++it) {
-        std::vector<double> eV;
-        if (symmetric) {
-            eV = atomMaps[linkType][*it];
-        } else {
-            if (fanin) eV = asymAtomMaps[linkType].second[*it];
-            else eV = asymAtomMaps[linkType].first[*it];
-        }
-        double testChoiceWeight = *std::max_element(eV.begin(), eV.end());
-        if (testChoiceWeight < bestChoiceWeight) {
-            bestChoice = *it;
-            bestChoiceWeight = testChoiceWeight;
+    //pick the next pivots to maximize their distance from their closest
+    //pivot (maximizing distance = minimizing path weight). Only the
+    //pivots already committed are taken into account, so the pivots of
+    //one batch can be searched independently.
+    const AtomEmbedding& aE = getAtomEmbedding(linkType, fanin);
+    std::vector<std::pair<double, size_t> > candidates;
+    for (size_t i=0; i<nodes.size(); ++i) {
+        //Use exact weights when kept, so that a compact embedding gets the
+        //same pivots as an exact one
+        AtomEmbedding::Row row = aE.find(nodes[i]);
+        EmbedSpan eV = aE.hasExact() ? aE.getExactRow(row) : aE.getRow(row);
+        double testChoiceWeight = 0;
+        for (size_t d=0; d<pivots.size(); ++d)
+            testChoiceWeight = std::max(testChoiceWeight, eV[d]);
+        //Nodes at full weight from some pivot are never better than the
+        //default choice of the last node
+        if (testChoiceWeight < 1) {
+            candidates.push_back(std::make_pair(testChoiceWeight, i));
         }
     }
-    return bestChoice;
+    //Lowest weight first; ties keep the node order, like a serial scan
+    count = std::min(count, nodes.size());
+    std::stable_sort(candidates.begin(), candidates.end(),
+        [](const std::pair<double, size_t>& a,
+           const std::pair<double, size_t>& b) { return a.first < b.first; });
+    HandleSeq result;
+    for (size_t i=0; i<candidates.size() && result.size()<count; ++i)
+        result.push_back(nodes[candidates[i].second]);
+    for (HandleSeq::const_reverse_iterator it=nodes.rbegin();
+         result.size()<count; ++it) {
+        if (std::find(result.begin(), result.end(), *it)==result.end())
+            result.push_back(*it);
+    }
+    return result;
+}
+
+void DimEmbedModule::embedDirection(Type linkType, const EmbedGraph& graph,
+                                    int numDimensions,
+                                    const EmbedParams& params, bool fanin)
+{
+    HandleSeq nodes = graph.getNodes();//candidates for new pivots
+    size_t batch = params.pivotBatch > 0 ? params.pivotBatch : 1;
+    int numPivots = 0;
+    while (numPivots < numDimensions && !nodes.empty()) {
+        HandleSeq newPivots;
+        //The first pivot is arbitrary; the rest are picked farthest-first
+        if (numPivots==0) newPivots.push_back(nodes.back());
+        else newPivots = pickPivots(linkType, nodes,
+                             std::min(batch, (size_t)(numDimensions-numPivots)),
+                             fanin);
+        for (const Handle& p : newPivots)
+            nodes.erase(std::find(nodes.begin(), nodes.end(), p));
+        addPivots(newPivots, linkType, graph, fanin, params);
+        numPivots += newPivots.size();
+    }
 }
 
 void DimEmbedModule::embedAtomSpace(Type linkType,
-                                    int _numDimensions)
+                                    int numDimensions)
+{
+    embedAtomSpace(linkType, numDimensions, EmbedParams());
+}
+
+void DimEmbedModule::embedAtomSpaceBatched(Type linkType, int numDimensions,
+                                           int pivotBatch)
+{
+    EmbedParams params;
+    params.pivotBatch = pivotBatch;
+    embedAtomSpace(linkType, numDimensions, params);
+}
+
+void DimEmbedModule::embedAtomSpace(Type linkType,
+                                    int _numDimensions,
+                                    const EmbedParams& params)
 {
     if (!nameserver().isLink(linkType))
         throw InvalidParamException(TRACE_INFO,
@@ -361,57 +821,222 @@ void DimEmbedModule::embedAtomSpace(Type linkType,
     int numDimensions = 5;
     if (_numDimensions > 0) numDimensions = _numDimensions;
 
-    bool fanin=false;
+    //Snapshot the linkType subgraph once; every pivot is searched on it
+    EmbedGraph graph(*as, linkType);
+    if (graph.numNodes()==0) return;
+    if (graph.numNodes() < (size_t) numDimensions) numDimensions = graph.numNodes();
     dimensionMap[linkType]=numDimensions;
-    //const HandleSeq& pivots = getPivots(linkType);
-    HandleSeq nodes;//candidates for new pivots
-    as->get_handles_by_type(std::back_inserter(nodes), NODE, true);
-    if (nodes.empty()) return;
-    if (nodes.size() < (size_t) numDimensions) numDimensions = nodes.size();
-
-    for (int i=0; i<numDimensions; ++i) {
-        Handle newPivot;
-        if (i!=0) newPivot = pickPivot(linkType,nodes,fanin);
-        else newPivot = nodes.back();
-        nodes.erase(std::find(nodes.begin(), nodes.end(), newPivot));
-        addPivot(newPivot, linkType, fanin);
-        if (!symmetric && !fanin && (nodes.empty() || i==numDimensions-1)) {
-            fanin=true;
-            nodes.clear();
-            as->get_handles_by_type(std::back_inserter(nodes), NODE, true);
-            i=-1;
-        }
 
+    //Give every node of the graph a row (in graph order) of zeros, to be
+    //filled in one column per pivot
+    //The store also picks the distance kernels for its row length here,
+    //once for the whole life of the embedding
+    AtomEmbedding aE(numDimensions, params.precision, params.exactRerank);
+    logger().debug("[DimEmbedModule] %d dimensions (%d padded), %s%s kernels",
+                   numDimensions, (int) aE.getPaddedDimensions(),
+                   &aE.getDistanceKernels() == &distance_kernels()
+                       ? "" : "unrolled ",
+                   aE.getDistanceKernels().name);
+    aE.reserve(graph.numNodes());
+    for (const Handle& node : graph.getNodes()) aE.add(node);
+
+    if (symmetric) {
+        atomMaps[linkType] = aE;
+        embedDirection(linkType, graph, numDimensions, params, false);
+    } else {
+        //The two directions only share the (read-only) graph, so they are
+        //embedded at the same time, each picking its own pivots. Their
+        //map entries are made up front so neither thread inserts into a
+        //map the other one is reading.
+        asymAtomMaps[linkType] = std::make_pair(aE, aE);
+        asymPivotsMap[linkType];
+        getThreadPool();
+        run_concurrently(
+            [&]() { embedDirection(linkType, graph, numDimensions, params, false); },
+            [&]() { embedDirection(linkType, graph, numDimensions, params, true); });
     }
-    //Now that all the points are calculated, we construct a
-    //cover tree for them.
+
+    //Now that all the points are calculated, we index them.
+    buildIndices(linkType);
+    //logger().info("done embedding");
+}
+
+EmbedIndexPtr DimEmbedModule::buildIndex(Type linkType,
+                                         const AtomEmbedding& aE)
+{
+    const EmbedIndexParams& params = getIndexParams(linkType);
     //since every element of each embedding vector ranges from 0 to 1, no
     //two elements will have distance greater than numDimensions.
-    if (symmetric) {
-        CoverTree<CoverTreePoint>& cTree =
-            embedTreeMap.insert(std::make_pair(linkType,CoverTree<CoverTreePoint>(numDimensions+.1))).first->second;
-        AtomEmbedding& aE = atomMaps[linkType];
-        AtomEmbedding::const_iterator it = aE.begin();
-        for (;it!=aE.end();++it) {
-            cTree.insert(CoverTreePoint(it->first,it->second));
-        }
+    EmbedIndexPtr index = make_embed_index(aE, params,
+                                           aE.getDimensions()+.1);
+    if (params.type==IVF_INDEX && aE.size()>0) {
+        //The coarse cells are k-means clusters of the embedding, found on
+        //a sample of a few dozen points per cell
+        size_t cells = params.numCells ? params.numCells
+                                       : (size_t) std::sqrt((double) aE.size());
+        cells = std::max((size_t) 1, std::min(cells, aE.size()));
+        std::vector<AtomEmbedding::Row> live;
+        for (AtomEmbedding::Row r=0; r<aE.numRows(); ++r)
+            if (aE.isLive(r)) live.push_back(r);
+        size_t numSamples = std::min(live.size(), 64*cells);
+        std::vector<AtomEmbedding::Row> sample;
+        for (size_t i=0; i<numSamples; ++i)
+            sample.push_back(live[i * live.size() / numSamples]);
+        std::vector<int> clusterid;
+        static_cast<IvfIndex&>(*index).setCentroids(
+            kCluster(aE, sample, cells, 1, false, clusterid,
+                     &getThreadPool()));
+    }
+    index->build(&getThreadPool());
+    return index;
+}
+
+void DimEmbedModule::buildIndices(Type linkType)
+{
+    _knnCache.clear(linkType);
+    if (nameserver().isA(linkType,UNORDERED_LINK)) {
+        embedIndexMap[linkType] = buildIndex(linkType, atomMaps[linkType]);
     } else {
-        std::pair<CoverTree<CoverTreePoint>, CoverTree<CoverTreePoint> >& cTrees
-            = asymEmbedTreeMap.insert(std::make_pair(linkType,
-                                            std::make_pair(CoverTree<CoverTreePoint>(numDimensions+.1), CoverTree<CoverTreePoint>(numDimensions+.1)))).first->second;
         std::pair<AtomEmbedding, AtomEmbedding>& aE = asymAtomMaps[linkType];
-        const AtomEmbedding& aE1 = aE.first;
-        AtomEmbedding::const_iterator it = aE1.begin();
-        for (;it!=aE1.end();++it) {
-            cTrees.first.insert(CoverTreePoint(it->first,it->second));
-        }
-        const AtomEmbedding& aE2 = aE.second;
-        it = aE2.begin();
-        for (;it!=aE2.end();++it) {
-            cTrees.second.insert(CoverTreePoint(it->first,it->second));
+        std::pair<EmbedIndexPtr, EmbedIndexPtr>& indices =
+            asymEmbedIndexMap[linkType];
+        getThreadPool();
+        run_concurrently(
+            [&]() { indices.first = buildIndex(linkType, aE.first); },
+            [&]() { indices.second = buildIndex(linkType, aE.second); });
+    }
+}
+
+EmbedIndex& DimEmbedModule::getIndex(Type l, bool fanin)
+{
+    return const_cast<EmbedIndex&>(
+        static_cast<const DimEmbedModule*>(this)->getIndex(l, fanin));
+}
+
+const EmbedIndex& DimEmbedModule::getIndex(Type l, bool fanin) const
+{
+    return *getIndexPtr(l, fanin);
+}
+
+void DimEmbedModule::unindexRow(Type l, bool fanin, AtomEmbedding::Row r)
+{
+    //While a batch applies, a row leaves its index before its first
+    //change only (a row new to the embedding was never in it)
+    if (_applyingBatch &&
+        !_batchRows.insert(IndexRow(std::make_pair(l, fanin), r)).second)
+        return;
+    forgetNeighborsOf(l, fanin, r);
+    getIndex(l, fanin).remove(r);
+}
+
+void DimEmbedModule::indexRow(Type l, bool fanin, AtomEmbedding::Row r)
+{
+    if (_applyingBatch) {
+        _batchRows.insert(IndexRow(std::make_pair(l, fanin), r));
+        return;
+    }
+    getIndex(l, fanin).insert(r);
+    forgetNeighborsOf(l, fanin, r);
+}
+
+void DimEmbedModule::beginAtomBatch()
+{
+    ++_batchDepth;
+}
+
+void DimEmbedModule::endAtomBatch()
+{
+    OC_ASSERT(_batchDepth>0 && !_applyingBatch);
+    if (--_batchDepth>0) return;
+    HandleSeq atoms;
+    std::set<Handle> live;
+    atoms.swap(_batchAtoms);
+    live.swap(_batchSet);
+
+    _applyingBatch = true;
+    //An atom that fails is logged and skipped, so the others still go in;
+    //the first failure is rethrown once they have
+    std::exception_ptr failure;
+    for (const Handle& h : atoms) {
+        if (!live.erase(h)) continue;
+        try {
+            handleAddSignal(h);
+        } catch (const std::exception& e) {
+            logger().error("[DimEmbedModule] Applying %s failed: %s",
+                           h->to_short_string().c_str(), e.what());
+            if (!failure) failure = std::current_exception();
+        } catch (...) {
+            logger().error("[DimEmbedModule] Applying %s failed",
+                           h->to_short_string().c_str());
+            if (!failure) failure = std::current_exception();
         }
     }
-    //logger().info("done embedding");
+    reindexBatchRows();
+    if (failure) std::rethrow_exception(failure);
+}
+
+DimEmbedModule::AtomBatch::AtomBatch(DimEmbedModule& module)
+    : _module(module), _open(true)
+{
+    _module.beginAtomBatch();
+}
+
+DimEmbedModule::AtomBatch::~AtomBatch()
+{
+    if (!_open) return;
+    try {
+        end();
+    } catch (const std::exception& e) {
+        logger().error("[DimEmbedModule] Applying an atom batch failed: %s",
+                       e.what());
+    } catch (...) {
+        logger().error("[DimEmbedModule] Applying an atom batch failed");
+    }
+}
+
+void DimEmbedModule::AtomBatch::end()
+{
+    if (!_open) return;
+    _open = false;
+    _module.endAtomBatch();
+}
+
+void DimEmbedModule::reindexBatchRows()
+{
+    _applyingBatch = false;
+    std::set<IndexRow> rows;
+    rows.swap(_batchRows);
+    for (const IndexRow& row : rows) {
+        Type l = row.first.first;
+        bool fanin = row.first.second;
+        if (!isEmbedded(l)) continue;
+        const AtomEmbedding& aE = getAtomEmbedding(l, fanin);
+        if (row.second<aE.numRows() && aE.isLive(row.second))
+            indexRow(l, fanin, row.second);
+    }
+}
+
+void DimEmbedModule::forgetNeighborsOf(Type l, bool fanin,
+                                       AtomEmbedding::Row r)
+{
+    //The answers of an HNSW graph depend on its links, which any change
+    //may rewire
+    if (getIndexParams(l).type==HNSW_INDEX)
+        _knnCache.clear(l, fanin);
+    else
+        _knnCache.pointChanged(l, fanin, getAtomEmbedding(l, fanin).getRow(r));
+}
+
+const EmbedIndexPtr& DimEmbedModule::getIndexPtr(Type l, bool fanin) const
+{
+    if (nameserver().isA(l,UNORDERED_LINK)) {
+        EmbedIndexMap::const_iterator it = embedIndexMap.find(l);
+        OC_ASSERT(it!=embedIndexMap.end());
+        return it->second;
+    }
+    AsymEmbedIndexMap::const_iterator it = asymEmbedIndexMap.find(l);
+    OC_ASSERT(it!=asymEmbedIndexMap.end());
+    return fanin ? it->second.second : it->second.first;
 }
 
 std::vector<double> DimEmbedModule::addNode(Handle h,
@@ -457,21 +1082,16 @@ std::vector<double> DimEmbedModule::addNode(Handle h,
         }
     }
     */
+    //(Re)start h at the origin. Its old point has to leave the index
+    //before its row is reused.
+    removeNode(h, linkType);
     if (symmetric) {
-        atomMaps[linkType][h] = newEmbedding;
-        EmbedTreeMap::iterator treeMapIt = embedTreeMap.find(linkType);
-        OC_ASSERT(treeMapIt!=embedTreeMap.end());
-        CoverTree<CoverTreePoint>& cTree = treeMapIt->second;
-        cTree.insert(CoverTreePoint(h,newEmbedding));
+        AtomEmbedding& aE = atomMaps[linkType];
+        indexRow(linkType, false, aE.add(h));
     } else {
-        asymAtomMaps[linkType].first[h] = newEmbedding;
-        asymAtomMaps[linkType].second[h] = newEmbedding;
-        AsymEmbedTreeMap::iterator treeMapIt = asymEmbedTreeMap.find(linkType);
-        OC_ASSERT(treeMapIt!=asymEmbedTreeMap.end());
-        CoverTree<CoverTreePoint>& cTree1 = treeMapIt->second.first;
-        cTree1.insert(CoverTreePoint(h,newEmbedding));
-        CoverTree<CoverTreePoint>& cTree2 = treeMapIt->second.second;
-        cTree2.insert(CoverTreePoint(h,newEmbedding));
+        std::pair<AtomEmbedding, AtomEmbedding>& aE = asymAtomMaps[linkType];
+        indexRow(linkType, false, aE.first.add(h));
+        indexRow(linkType, true, aE.second.add(h));
     }
     return newEmbedding;
 }
@@ -489,24 +1109,19 @@ void DimEmbedModule::removeNode(Handle h,
         throw std::string("No embedding exists for type %s", tName);
     }
     bool symmetric = nameserver().isA(linkType,UNORDERED_LINK);
+    //Nodes without any links of linkType are not part of the embedding
+    if (!getAtomEmbedding(linkType).contains(h)) return;
     if (symmetric) {
-        EmbedTreeMap::iterator treeMapIt = embedTreeMap.find(linkType);
-        OC_ASSERT(treeMapIt!=embedTreeMap.end());
-        CoverTree<CoverTreePoint>& cTree = treeMapIt->second;
-        AtomEmbedding::iterator aEit = atomMaps[linkType].find(h);
-        cTree.remove(CoverTreePoint(h,aEit->second));
-        atomMaps[linkType].erase(aEit);
+        AtomEmbedding& aE = atomMaps[linkType];
+        unindexRow(linkType, false, aE.find(h));
+        aE.remove(h);
     } else {
-        AsymEmbedTreeMap::iterator treeMapIt = asymEmbedTreeMap.find(linkType);
-        OC_ASSERT(treeMapIt!=asymEmbedTreeMap.end());
-        CoverTree<CoverTreePoint>& cTree1 = treeMapIt->second.first;
-        CoverTree<CoverTreePoint>& cTree2 = treeMapIt->second.second;
-        AtomEmbedding::iterator aEit = asymAtomMaps[linkType].first.find(h);
-        cTree1.remove(CoverTreePoint(h,aEit->second));
-        asymAtomMaps[linkType].first.erase(aEit);
-        aEit = asymAtomMaps[linkType].second.find(h);
-        cTree2.remove(CoverTreePoint(h,aEit->second));
-        asymAtomMaps[linkType].second.erase(aEit);
+        AtomEmbedding& aE1 = asymAtomMaps[linkType].first;
+        unindexRow(linkType, false, aE1.find(h));
+        aE1.remove(h);
+        AtomEmbedding& aE2 = asymAtomMaps[linkType].second;
+        unindexRow(linkType, true, aE2.find(h));
+        aE2.remove(h);
     }
 }
 
@@ -529,40 +1144,38 @@ void DimEmbedModule::addLink(Handle h,
 
 void DimEmbedModule::symAddLink(Handle h, Type linkType)
 {
-    EmbedTreeMap::iterator treeMapIt = embedTreeMap.find(linkType);
-    OC_ASSERT(treeMapIt!=embedTreeMap.end());
-    CoverTree<CoverTreePoint>& cTree = treeMapIt->second;
     int dim = dimensionMap[linkType];
     AtomEmbedding& aE = atomMaps[linkType];
     TruthValuePtr linkTV = h->getTruthValue();
     double weight = linkTV->get_confidence() * linkTV->get_mean();
     HandleSeq nodes;
     if (LinkCast(h)) nodes = LinkCast(h)->getOutgoingSet();
+    //Nodes new to linkType join the embedding at the origin first
+    for (HandleSeq::iterator it=nodes.begin();it!=nodes.end();++it) {
+        if (!aE.contains(*it)) addNode(*it, linkType);
+    }
     for (HandleSeq::iterator it=nodes.begin();it!=nodes.end();++it) {
-        AtomEmbedding::iterator aEit = aE.find(*it);
+        AtomEmbedding::Row row = aE.find(*it);
         bool changed=false;
         for (HandleSeq::iterator it2=nodes.begin();it2!=nodes.end();++it2) {
-            std::vector<double> vec = aE[*it2];
+            AtomEmbedding::Row row2 = aE.find(*it2);
             for (int i=0; i<dim; ++i) {
-                if ((aEit->second)[i]<weight*vec[i]) {
+                if (aE.get(row,i)<weight*aE.get(row2,i)) {
                     if (!changed) {
                         changed=true;
-                        cTree.remove(CoverTreePoint(aEit->first,aEit->second));
+                        unindexRow(linkType, false, row);
                     }
-                    (aEit->second)[i]=weight*vec[i];
+                    aE.set(row, i, weight*aE.get(row2,i));
                 }
             }
         }
-        if (changed) cTree.insert(CoverTreePoint(aEit->first,aEit->second));
+        if (changed)
+            indexRow(linkType, false, row);
     }
 }
 
 void DimEmbedModule::asymAddLink(Handle h, Type linkType)
 {
-    AsymEmbedTreeMap::iterator treeMapIt = asymEmbedTreeMap.find(linkType);
-    OC_ASSERT(treeMapIt!=asymEmbedTreeMap.end());
-    CoverTree<CoverTreePoint>& cTreeForw = treeMapIt->second.first;
-    CoverTree<CoverTreePoint>& cTreeBackw = treeMapIt->second.second;
     int dim = dimensionMap[linkType];
     AtomEmbedding& aEForw = asymAtomMaps[linkType].first;
     AtomEmbedding& aEBackw = asymAtomMaps[linkType].second;
@@ -570,37 +1183,45 @@ void DimEmbedModule::asymAddLink(Handle h, Type linkType)
     double weight = linkTV->get_confidence() * linkTV->get_mean();
     HandleSeq nodes;
     if (LinkCast(h)) nodes = LinkCast(h)->getOutgoingSet();
+    //Nodes new to linkType join the embedding at the origin first
+    for (HandleSeq::iterator it=nodes.begin();it!=nodes.end();++it) {
+        if (!aEForw.contains(*it)) addNode(*it, linkType);
+    }
     Handle source = nodes.front();
     HandleSeq::iterator it = nodes.begin();
     ++it;
-    std::vector<double>& sourceVecForw = aEForw[source];
-    const std::vector<double>& sourceVecBackw = aEBackw[source];
+    AtomEmbedding::Row sourceForw = aEForw.find(source);
+    AtomEmbedding::Row sourceBackw = aEBackw.find(source);
     bool sourceChanged=false;
     for (;it!=nodes.end();++it) {
         bool changed=false;
-        std::vector<double>& vecBackw = aEBackw[*it];
+        AtomEmbedding::Row rowBackw = aEBackw.find(*it);
         for (int i=0; i<dim; ++i) {
-            if (vecBackw[i]<weight*sourceVecBackw[i]) {
+            double alt = weight*aEBackw.get(sourceBackw,i);
+            if (aEBackw.get(rowBackw,i)<alt) {
                 if (!changed) {
                     changed=true;
-                    cTreeBackw.remove(CoverTreePoint(*it,vecBackw));
+                    unindexRow(linkType, true, rowBackw);
                 }
-                vecBackw[i]=weight*sourceVecBackw[i];
+                aEBackw.set(rowBackw, i, alt);
             }
         }
-        if (changed) cTreeBackw.insert(CoverTreePoint(*it,vecBackw));
-        const std::vector<double>& vecForw = aEForw[*it];
+        if (changed)
+            indexRow(linkType, true, rowBackw);
+        AtomEmbedding::Row rowForw = aEForw.find(*it);
         for (int i=0; i<dim; ++i) {
-            if (sourceVecForw[i]<weight*vecForw[i]) {
+            double alt = weight*aEForw.get(rowForw,i);
+            if (aEForw.get(sourceForw,i)<alt) {
                 if (!sourceChanged) {
                     sourceChanged=true;
-                    cTreeForw.remove(CoverTreePoint(source,sourceVecForw));
+                    unindexRow(linkType, false, sourceForw);
                 }
-                sourceVecForw[i]=weight*vecForw[i];
+                aEForw.set(sourceForw, i, alt);
             }
         }
     }
-    if (sourceChanged) cTreeForw.insert(CoverTreePoint(source, sourceVecForw));
+    if (sourceChanged)
+        indexRow(linkType, false, sourceForw);
 }
 
 void DimEmbedModule::clearEmbedding(Type linkType)
@@ -611,28 +1232,29 @@ void DimEmbedModule::clearEmbedding(Type linkType)
             nameserver().getTypeName(linkType).c_str());
     bool symmetric = nameserver().isA(linkType,UNORDERED_LINK);
 
-    HandleSeq pivots  = pivotsMap[linkType];
+    //Only the pivots of the fanin=false direction had their VLTI raised
+    HandleSeq pivots = symmetric ? pivotsMap[linkType]
+                                 : asymPivotsMap[linkType].first;
     for (HandleSeq::iterator it = pivots.begin(); it!=pivots.end(); ++it) {
         if (as->is_valid_handle(*it)) _bank->dec_vlti(*it);
     }
+    _knnCache.clear(linkType);
     if (symmetric) {
         atomMaps.erase(linkType);
-        embedTreeMap.erase(linkType);
+        embedIndexMap.erase(linkType);
     } else {
         asymAtomMaps.erase(linkType);
-        asymEmbedTreeMap.erase(linkType);
+        asymEmbedIndexMap.erase(linkType);
     }
     pivotsMap.erase(linkType);
+    asymPivotsMap.erase(linkType);
     dimensionMap.erase(linkType);
 }
 
 void DimEmbedModule::logAtomEmbedding(Type linkType)
 {
-    bool symmetric = nameserver().isA(linkType,UNORDERED_LINK);
-    AtomEmbedding atomEmbedding;
-    if (symmetric) atomEmbedding=atomMaps[linkType];
-    else atomEmbedding=asymAtomMaps[linkType].first;
     const HandleSeq& pivots = getPivots(linkType);
+    const AtomEmbedding& atomEmbedding = getAtomEmbedding(linkType);
 
     std::ostringstream oss;
 
@@ -645,18 +1267,17 @@ void DimEmbedModule::logAtomEmbedding(Type linkType)
         }
     }
     oss << "Node Embeddings:" << std::endl;
-    AtomEmbedding::const_iterator it;
-    for (it=atomEmbedding.begin(); it!=atomEmbedding.end(); ++it){
-        if (as->is_valid_handle(it->first)) {
-            oss << (it->first)->to_short_string() << " : (";
+    for (AtomEmbedding::Row r=0; r<atomEmbedding.numRows(); ++r){
+        if (!atomEmbedding.isLive(r)) continue;
+        const Handle& h = atomEmbedding.getHandle(r);
+        if (as->is_valid_handle(h)) {
+            oss << h->to_short_string() << " : (";
         } else {
-            oss << "[NODE'S BEEN DELETED H=" << it->first << "] : (";
+            oss << "[NODE'S BEEN DELETED H=" << h << "] : (";
         }
-        const std::vector<double>& embedvector = it->second;
-        for (std::vector<double>::const_iterator it2=embedvector.begin();
-            it2!=embedvector.end();
-            ++it2){
-            oss << *it2 << " ";
+        EmbedSpan embedvector = atomEmbedding.getRow(r);
+        for (size_t i=0; i<embedvector.size(); ++i){
+            oss << embedvector[i] << " ";
         }
         oss << ")" << std::endl;
     }
@@ -671,20 +1292,19 @@ void DimEmbedModule::printEmbedding()
     oss << "Node Embeddings" << std::endl;
     for (; mit != atomMaps.end(); ++mit) {
         oss << "=== for type" << nameserver().getTypeName(mit->first).c_str() << std::endl;
-        AtomEmbedding atomEmbedding=mit->second;
-        AtomEmbedding::const_iterator it;
-        for (it=atomEmbedding.begin(); it!=atomEmbedding.end(); ++it){
-            if (as->is_valid_handle(it->first)) {
-                oss << (it->first)->to_short_string() << " : (";
+        const AtomEmbedding& atomEmbedding=mit->second;
+        for (AtomEmbedding::Row r=0; r<atomEmbedding.numRows(); ++r){
+            if (!atomEmbedding.isLive(r)) continue;
+            const Handle& h = atomEmbedding.getHandle(r);
+            if (as->is_valid_handle(h)) {
+                oss << h->to_short_string() << " : (";
             } else {
                 oss << "[NODE'S BEEN DELETED. handle=";
-                oss << it->first.value() << "] : (";
+                oss << h.value() << "] : (";
             }
-            const std::vector<double>& embedVector = it->second;
-            for (std::vector<double>::const_iterator it2=embedVector.begin();
-                it2!=embedVector.end();
-                ++it2){
-                oss << *it2 << " ";
+            EmbedSpan embedVector = atomEmbedding.getRow(r);
+            for (size_t i=0; i<embedVector.size(); ++i){
+                oss << embedVector[i] << " ";
             }
             oss << ")" << std::endl;
         }
@@ -706,6 +1326,40 @@ bool DimEmbedModule::isEmbedded(Type linkType) const
     return false;
 }
 
+std::vector<std::vector<double> >
+DimEmbedModule::kCluster(const AtomEmbedding& aE,
+                         const std::vector<AtomEmbedding::Row>& rows,
+                         int numClusters, int npass, bool transpose,
+                         std::vector<int>& clusterid, ThreadPool* pool,
+                         const ClusterParams& params) const
+{
+    int numDimensions=aE.getDimensions();
+    int numVectors=rows.size();
+    //The rows are clustered where they are stored; clustering the pivots
+    //needs the columns gathered first
+    std::vector<EmbedSpan> points;
+    std::vector<double> columns;
+    if (!transpose) {
+        for (int i=0;i<numVectors;++i) points.push_back(aE.getRow(rows[i]));
+    } else {
+        columns.resize(numDimensions*numVectors);
+        for (int i=0;i<numVectors;++i) {
+            EmbedSpan row = aE.getRow(rows[i]);
+            for (int j=0;j<numDimensions;++j)
+                columns[numVectors*j+i]=row[j];
+        }
+        for (int j=0;j<numDimensions;++j)
+            points.push_back(EmbedSpan(&columns[numVectors*j], numVectors));
+    }
+
+    KMeans kMeans(pool);
+    kMeans.setMiniBatch(params.batchSize, params.tolerance);
+    kMeans.run(points, numClusters, npass);
+    //clusterid[i]==j will indicate that row (or pivot) i belongs in cluster j
+    clusterid = kMeans.getClusterIds();
+    return kMeans.getCentroids();
+}
+
 ClusterSeq DimEmbedModule::kMeansCluster(Type l, int numClusters, int npass, bool pivotWise)
 {
     if (!isEmbedded(l)) {
@@ -713,82 +1367,29 @@ ClusterSeq DimEmbedModule::kMeansCluster(Type l, int numClusters, int npass, boo
         logger().error("No embedding exists for type %s", tName);
         throw std::string("No embedding exists for type %s", tName);
     }
-    int numDimensions=dimensionMap[l];
-    const AtomEmbedding& aE = atomMaps[l];
+    const AtomEmbedding& aE = getAtomEmbedding(l);
+    int numDimensions=aE.getDimensions();
     int numVectors=aE.size();
     if (numVectors<numClusters) {
         logger().error("Cannot make more clusters than there are nodes");
         throw std::string("Cannot make more clusters than there are nodes");
     }
-    //create the required matrices for the clustering function (which
-    //takes double** as an argument...)
-    double* embedding = new double[numDimensions*numVectors];
-    double** embedMatrix = new double*[numVectors];
-    int* maskArray = new int[numDimensions*numVectors];
-    int** mask = new int*[numVectors];
-    for (int i=0;i<numVectors;++i) {
-        embedMatrix[i] = embedding + numDimensions*i;
-        mask[i] = maskArray + numDimensions*i;
-    }
-    Handle* handleArray = new Handle[numVectors];
-    AtomEmbedding::const_iterator aEit=aE.begin();
-    int i=0;
-    int j;
-    //add the values to the embeddingmatrix...
-    for (;aEit!=aE.end();++aEit) {
-        handleArray[i]=aEit->first;
-        const std::vector<double>& embedding = aEit->second;
-        std::vector<double>::const_iterator vit=embedding.begin();
-        j=0;
-        for (;vit!=embedding.end();++vit) {
-            embedMatrix[i][j]=*vit;
-            mask[i][j]=1;
-            j++;
-        }
-        i++;
-    }
-    double* weight = new double[numDimensions];
-    for (int i=0;i<numDimensions;++i) {weight[i]=1;}
-
-    int* clusterid = new int[numVectors]; //stores the result of clustering
-    double error;
-    int ifound;
-    for (int i=0;i<numVectors;++i) {
-        for (int j=0;j<numDimensions;++j) {
-            mask[i][j]=1;
-        }
-    }
-    int transpose;
-    if (pivotWise) transpose=1;
-    else transpose=0;
-    //clusterid[i]==j will indicate that handle i belongs in cluster j
-    ::kcluster(numClusters, numVectors, numDimensions, embedMatrix,
-               mask, weight, transpose, npass, 'a', 'e', clusterid, &error, &ifound);
-
-    //Now that we have the clusters (stored in clusterid), we find the centroid
-    //of each cluster so we will know how to weight the inheritance links
-    double* centroidArray = new double[numClusters*numDimensions];
-    double** centroidMatrix = new double*[numClusters];
-
-    int* cmaskArray = new int[numClusters*numDimensions];
-    int** cmask = new int*[numClusters];
-    for (int i=0;i<numClusters;++i) {
-        centroidMatrix[i] = centroidArray + numDimensions*i;
-        cmask[i] = cmaskArray + numDimensions*i;
-    }
+    //Those of removed nodes are skipped
+    std::vector<AtomEmbedding::Row> rows;
+    for (AtomEmbedding::Row r=0; r<aE.numRows(); ++r)
+        if (aE.isLive(r)) rows.push_back(r);
+    std::vector<int> clusterid; //stores the result of clustering
+    std::vector<std::vector<double> > centroids =
+        kCluster(aE, rows, numClusters, npass, pivotWise, clusterid,
+                 &getThreadPool(), getClusterParams(l));
 
-    //Stores the centroid of each cluster in centroidMatrix
-    ::getclustercentroids(numClusters, numVectors,
-                          numDimensions, embedMatrix,
-                          mask, clusterid, centroidMatrix,
-                          cmask, 0, 'a');
     ClusterSeq clusters(numClusters);
     const HandleSeq& pivots = getPivots(l);
     if (!pivotWise) {
         for (int i=0;i<numVectors;++i) {
-            //clusterid[i] indicates which cluster handleArray[i] is in.
+            //clusterid[i] indicates which cluster rows[i] is in.
             int clustInd=clusterid[i];
-            clusters[clustInd].first.push_back(handleArray[i]);
+            clusters[clustInd].first.push_back(aE.getHandle(rows[i]));
         }
     } else {
         for (int i=0;i<numDimensions;++i) {
@@ -797,9 +1398,7 @@ ClusterSeq DimEmbedModule::kMeansCluster(Type l, int numClusters, int npass, boo
         }
     }
     for (int i=0;i<numClusters;++i) {
-        std::vector<double> centroid(centroidMatrix[i],
-                                     centroidMatrix[i]+numDimensions);
-        clusters[i].second=centroid;
+        clusters[i].second=centroids[i];
     }
 
     //for (HandleSeqSeq::const_iterator it=clusters.begin();
@@ -808,21 +1407,36 @@ ClusterSeq DimEmbedModule::kMeansCluster(Type l, int numClusters, int npass, boo
     //    std::cout << "Separation: " << separation(*it,l) << std::endl;
     //}
 
-    delete[] embedding;
-    delete[] embedMatrix;
-    delete[] maskArray;
-    delete[] mask;
-    delete[] handleArray;
-    delete[] weight;
-    delete[] clusterid;
-    delete[] centroidArray;
-    delete[] centroidMatrix;
-    delete[] cmaskArray;
-    delete[] cmask;
-
     return clusters;
 }
 
+void DimEmbedModule::setClusterParams(Type l, const ClusterParams& params)
+{
+    if (!nameserver().isLink(l))
+        throw InvalidParamException(TRACE_INFO,
+            "DimensionalEmbedding requires link type, not %s",
+            nameserver().getTypeName(l).c_str());
+    clusterParamsMap[l] = params;
+}
+
+const DimEmbedModule::ClusterParams&
+DimEmbedModule::getClusterParams(Type l) const
+{
+    static const ClusterParams defaults;
+    std::map<Type, ClusterParams>::const_iterator it =
+        clusterParamsMap.find(l);
+    return it==clusterParamsMap.end() ? defaults : it->second;
+}
+
+void DimEmbedModule::useMiniBatchKMeans(Type l, int batchSize,
+                                        double tolerance)
+{
+    ClusterParams params = getClusterParams(l);
+    params.batchSize = std::max(0, batchSize);
+    if (tolerance > 0) params.tolerance = tolerance;
+    setClusterParams(l, params);
+}
+
 Handle add_prefixed_node(AtomSpace& as, Type t, const std::string& prefix)
 {
     static const char alphanum[] =
@@ -845,10 +1459,16 @@ Handle add_prefixed_node(AtomSpace& as, Type t, const std::string& prefix)
 }
 
 
-void DimEmbedModule::addKMeansClusters(Type l, int maxClusters,
-                                       double threshold, int kPasses)
+DimEmbedModule::ClusterSeq
+DimEmbedModule::findKMeansClusters(Type l, int maxClusters, double threshold,
+                                   int kPasses)
 {
-    const AtomEmbedding& aE = atomMaps[l];
+    if (!isEmbedded(l)) {
+        const char* tName = nameserver().getTypeName(l).c_str();
+        logger().error("No embedding exists for type %s", tName);
+        throw std::string("No embedding exists for type %s", tName);
+    }
+    const AtomEmbedding& aE = getAtomEmbedding(l);
     if (kPasses==-1) kPasses = (std::log(aE.size())/std::log(2))-1;
 
     typedef std::pair<double,std::pair<HandleSeq,std::vector<double> > > cPair;
@@ -858,45 +1478,97 @@ void DimEmbedModule::addKMeansClusters(Type l, int maxClusters,
     //make a Priority Queue of (HandleSeq,std::vector<double>) pairs, where
     //we can easily extract those with the lowest value to discard if we
     //exceed maxClusters.
+    std::vector<int> ks;
     int k = aE.size()/2;
     double c = std::pow(2,(std::log(k)/std::log(2))/kPasses);
     while(k>2) {
-        ClusterSeq newClusts = kMeansCluster(l,k);
-        for (ClusterSeq::iterator it = newClusts.begin();
-            it!=newClusts.end();++it) {
-            if (it->first.size()==1) continue;//ignore singleton clusters
-            //if we still have room for more clusters and the cluster quality
-            //is high enough, insert the cluster into the pQueue
-            double quality = separation(it->first,l)*homogeneity(it->first,l);
-            if (quality>threshold) {
-                if ( (int) clusters.size() < maxClusters) {
-                    clusters.insert(cPair(quality,*it));
-                } else {
-                    //if there is no room, but our new cluster is better
-                    //than the worst current cluster, replace the worst one
-                    pQueue_t::iterator p_it = clusters.begin();
-                    if (quality>p_it->first) {
-                        clusters.erase(p_it);
-                        clusters.insert(cPair(quality,*it));
+        ks.push_back(k);
+        if ((int) (k/c) >= k) break;
+        k=k/c;
+    }
+
+    //The k values are independent, but so are the blocks of points of a
+    //k-means run and the members scored after it, and what a k value
+    //costs is hard to foretell (small ones make large clusters, whose
+    //separation takes the longest to score). So as long as a run has a
+    //block of points for each thread, the k values run one at a time, on
+    //all of them. Only smaller embeddings run a wave of k values at once
+    //(as many as there are threads when the sweep can stop early), one
+    //per thread. The results are merged in the order of the sweep, which
+    //thus ends where a serial one would.
+    ThreadPool& pool = getThreadPool();
+    int patience = getClusterParams(l).patience;
+    size_t wave = aE.size()>=KMeans::BLOCK*pool.size() ? 1 :
+        patience>0 ? pool.size() : ks.size();
+    std::vector<ClusterSeq> results;
+    std::vector<std::vector<std::pair<double, double> > > scores;
+    int idle = 0; //k values in a row that added no cluster
+    for (size_t first=0; first<ks.size(); first+=wave) {
+        size_t n = std::min(wave, ks.size()-first);
+        results.assign(n, ClusterSeq());
+        scores.assign(n, std::vector<std::pair<double, double> >());
+        //A single k value runs on the calling thread, so it still
+        //spreads its own work over the pool
+        pool.parallelFor(n, [&](size_t i) {
+            results[i] = kMeansCluster(l, ks[first+i]);
+            scores[i] = scoreClusters(results[i], l);
+        });
+        for (size_t i=0; i<n && (patience<=0 || idle<patience); ++i) {
+            bool added = false;
+            for (size_t j=0; j<results[i].size(); ++j) {
+                const std::pair<HandleSeq,std::vector<double> >& cluster =
+                    results[i][j];
+                if (cluster.first.size()==1) continue;//ignore singletons
+                //if we still have room for more clusters and the cluster
+                //quality is high enough, insert the cluster into the pQueue
+                double quality = scores[i][j].second*scores[i][j].first;
+                if (quality>threshold) {
+                    if ( (int) clusters.size() < maxClusters) {
+                        clusters.insert(cPair(quality,cluster));
+                        added = true;
+                    } else {
+                        //if there is no room, but our new cluster is better
+                        //than the worst current cluster, replace the worst
+                        pQueue_t::iterator p_it = clusters.begin();
+                        if (quality>p_it->first) {
+                            clusters.erase(p_it);
+                            clusters.insert(cPair(quality,cluster));
+                            added = true;
+                        }
                     }
                 }
             }
+            idle = added || (int) clusters.size()<maxClusters ? 0 : idle+1;
         }
-        k=k/c;
+        if (patience>0 && idle>=patience) break;
     }
+    ClusterSeq best;
+    for (pQueue_t::iterator it = clusters.begin();it!=clusters.end();++it)
+        best.push_back(it->second);
+    return best;
+}
+
+void DimEmbedModule::addKMeansClusters(Type l, int maxClusters,
+                                       double threshold, int kPasses)
+{
+    ClusterSeq clusters = findKMeansClusters(l, maxClusters, threshold,
+                                             kPasses);
     const HandleSeq& pivots = getPivots(l);
-    const int& numDims = dimensionMap[l];
+    const int numDims = getAtomEmbedding(l).getDimensions();
+    //The embedding takes in the new atoms all at once, at the end, so the
+    //members' vectors below are the ones the clusters were found with
+    AtomBatch batch(*this);
     //Make a new node for each cluster and connect it with InheritanceLinks.
-    for (pQueue_t::iterator it = clusters.begin();it!=clusters.end();++it) {
-        const HandleSeq& cluster = it->second.first;
-        const std::vector<double>& centroid = it->second.second;
+    for (ClusterSeq::iterator it = clusters.begin();it!=clusters.end();++it) {
+        const HandleSeq& cluster = it->first;
+        const std::vector<double>& centroid = it->second;
         Handle newNode = add_prefixed_node(*as, CONCEPT_NODE, "cluster_");
-        std::vector<double> strNumer(0,numDims);
-        std::vector<double> strDenom(0,numDims);
+        std::vector<double> strNumer(numDims,0);
+        std::vector<double> strDenom(numDims,0);
         //Connect newNode to each handle in its cluster and each pivot
         for (HandleSeq::const_iterator it2=cluster.begin();
             it2!=cluster.end();++it2) {
-            const std::vector<double>& embedVec = getEmbedVector(*it2,l);
+            EmbedSpan embedVec = getEmbedVector(*it2,l);
             double dist = euclidDist(centroid,embedVec);
             //TODO: we should do some normalizing of this probably...
             double strength = sqrt(std::pow(2.0, -dist));
@@ -918,68 +1590,107 @@ void DimEmbedModule::addKMeansClusters(Type l, int maxClusters,
             hi->setTruthValue(hi->getTruthValue()->merge(tv));
         }
     }
+    batch.end();
 }
 
-double DimEmbedModule::homogeneity(const HandleSeq& cluster,
-                                   Type linkType) const
+std::vector<std::pair<double, double> >
+DimEmbedModule::scoreClusters(const std::vector<const HandleSeq*>& clusters,
+                              Type linkType, bool homogeneity,
+                              bool separation, ThreadPool* pool) const
 {
     if (!nameserver().isLink(linkType))
         throw InvalidParamException(TRACE_INFO,
             "DimensionalEmbedding requires link type, not %s",
             nameserver().getTypeName(linkType).c_str());
-    OC_ASSERT(cluster.size()>1);
+    if (!isEmbedded(linkType)) {
+        const char* tName = nameserver().getTypeName(linkType).c_str();
+        logger().error("No embedding exists for type %s", tName);
+        throw std::string("No embedding exists for type %s", tName);
+    }
+    const AtomEmbedding& aE = getAtomEmbedding(linkType);
+    const EmbedIndex& index = getIndex(linkType);
+
+    //The cluster of each row (-1 for none), so that the index can tell
+    //clustermates from outsiders
+    std::vector<int> label(aE.numRows(), -1);
+    std::vector<std::pair<int, AtomEmbedding::Row> > members;
+    for (size_t c=0; c<clusters.size(); ++c) {
+        for (const Handle& h : *clusters[c]) {
+            AtomEmbedding::Row r = aE.find(h);
+            if (r==AtomEmbedding::npos)
+                throw InvalidParamException(TRACE_INFO,
+                    "Atom is not part of the %s embedding",
+                    nameserver().getTypeName(linkType).c_str());
+            label[r] = c;
+            members.push_back(std::make_pair((int) c, r));
+        }
+    }
 
-    double average=0;
-    for (HandleSeq::const_iterator it=cluster.begin();it!=cluster.end();++it) {
-        double minDist=DBL_MAX;
-        //find the distance to nearest clustermate
-        const std::vector<double>& embedding = getEmbedVector(*it,linkType);
-        for (HandleSeq::const_iterator it2=cluster.begin();
-                                      it2!=cluster.end();++it2) {
-            if (*it==*it2) continue;
-            double dist=euclidDist(embedding,getEmbedVector(*it2,linkType));
-            if (dist<minDist) minDist=dist;
+    //The distance of each member to its nearest clustermate and outsider
+    std::vector<double> inside(members.size(), DBL_MAX);
+    std::vector<double> outside(members.size(), DBL_MAX);
+    std::function<void(size_t)> measure = [&](size_t i) {
+        int c = members[i].first;
+        AtomEmbedding::Row r = members[i].second;
+        CoverTreePoint q(aE, r);
+        std::vector<AtomEmbedding::Row> nearest;
+        if (homogeneity && clusters[c]->size()>1) {
+            nearest = index.kNearest(q, 1, [&](AtomEmbedding::Row s) {
+                return s!=r && label[s]==c;
+            });
+            if (!nearest.empty())
+                inside[i] = q.distance(CoverTreePoint(aE, nearest[0]));
+        }
+        if (separation) {
+            nearest = index.kNearest(q, 1, [&](AtomEmbedding::Row s) {
+                return label[s]!=c;
+            });
+            if (!nearest.empty())
+                outside[i] = q.distance(CoverTreePoint(aE, nearest[0]));
         }
-        average+=minDist;
+    };
+    if (pool) pool->parallelFor(members.size(), measure);
+    else for (size_t i=0; i<members.size(); ++i) measure(i);
+
+    std::vector<std::pair<double, double> > scores(clusters.size(),
+                                                   std::make_pair(0, DBL_MAX));
+    std::vector<double> average(clusters.size(), 0);
+    for (size_t i=0; i<members.size(); ++i) {
+        int c = members[i].first;
+        average[c] += inside[i] / clusters[c]->size();
+        scores[c].second = std::min(scores[c].second, outside[i]);
     }
-    average = average/cluster.size();
-    return 1.0/(1.0 + average);  //h=1/(1+A)
+    for (size_t c=0; c<clusters.size(); ++c)
+        if (clusters[c]->size()>1)
+            scores[c].first = 1.0/(1.0 + average[c]);  //h=1/(1+A)
+    return scores;
+}
+
+std::vector<std::pair<double, double> >
+DimEmbedModule::scoreClusters(const ClusterSeq& clusters, Type linkType)
+{
+    std::vector<const HandleSeq*> members;
+    for (const auto& cluster : clusters) members.push_back(&cluster.first);
+    return scoreClusters(members, linkType, true, true, &getThreadPool());
+}
+
+double DimEmbedModule::homogeneity(const HandleSeq& cluster,
+                                   Type linkType) const
+{
+    OC_ASSERT(cluster.size()>1);
+    return scoreClusters(std::vector<const HandleSeq*>(1, &cluster),
+                         linkType, true, false, 0)[0].first;
 }
 
 double DimEmbedModule::separation(const HandleSeq& cluster,
                                   Type linkType) const
 {
-    if (!nameserver().isLink(linkType))
-        throw InvalidParamException(TRACE_INFO,
-            "DimensionalEmbedding requires link type, not %s",
-            nameserver().getTypeName(linkType).c_str());
-
-    const AtomEmbedding& aE = (atomMaps.find(linkType))->second;
-    double minDist=DBL_MAX;
-    for (AtomEmbedding::const_iterator it=aE.begin();it!=aE.end();++it) {
-        bool inCluster=false; //whether *it is in cluster
-        bool better=false; //whether *it is closer to some element of cluster
-                           //than minDist
-        double dist;
-        for (HandleSeq::const_iterator it2=cluster.begin();
-                                      it2!=cluster.end();++it2) {
-            if (it->first==*it2) {
-                inCluster=true;
-                break;
-            }
-            dist = euclidDist(it->second,getEmbedVector(*it2,linkType));
-            if (dist<minDist) better=true;
-        }
-        //If the node is closer and it is not in the cluster, update minDist
-        if (better && !inCluster) {
-            minDist=dist;
-        }
-    }
-    return minDist;
+    return scoreClusters(std::vector<const HandleSeq*>(1, &cluster),
+                         linkType, false, true, 0)[0].second;
 }
 
-Handle DimEmbedModule::blendNodes(Handle n1,
-                                  Handle n2, Type l)
+std::vector<double> DimEmbedModule::blendVector(Handle n1, Handle n2,
+                                                Type l) const
 {
     if (!nameserver().isLink(l))
         throw InvalidParamException(TRACE_INFO,
@@ -993,48 +1704,60 @@ Handle DimEmbedModule::blendNodes(Handle n1,
         logger().error("No embedding exists for type %s", tName);
         throw std::string("No embedding exists for type %s", tName);
     }
-    const HandleSeq& pivots = getPivots(l);
-    const unsigned int numDims = (unsigned int) dimensionMap[l];
-    const std::vector<double>& embedVec1 = getEmbedVector(n1,l);
-    const std::vector<double>& embedVec2 = getEmbedVector(n2,l);
-    OC_ASSERT(numDims==embedVec1.size() &&
-              numDims==embedVec2.size() && numDims==pivots.size());
-    std::vector<double> newVec(embedVec1.begin(), embedVec1.end());
-
-    EmbedTreeMap::iterator treeMapIt = embedTreeMap.find(l);
-    OC_ASSERT(treeMapIt!=embedTreeMap.end());
-    CoverTree<CoverTreePoint>& cTree = treeMapIt->second;
+    const AtomEmbedding& aE = getAtomEmbedding(l);
+    const unsigned int numDims = aE.getDimensions();
+    EmbedSpan embedVec1 = getEmbedVector(n1,l);
+    EmbedSpan embedVec2 = getEmbedVector(n2,l);
+    OC_ASSERT(numDims==embedVec1.size() && numDims==embedVec2.size());
+    std::vector<double> newVec = embedVec1.toVector();
+
+    const EmbedIndex& index = getIndex(l);
     //For each pivot, see whether replacing embedVec1's embedding with
     //embedVec2's will make newVec farther from any existing point. Replace
-    //it if so.
+    //it if so. (newVec already holds embedVec2's coordinate when they are
+    //compared, so it keeps it either way, and the blend comes out as n2's
+    //vector.)
+    //The distance from newVec to its nearest point carries over from one
+    //dimension to the next, so each only takes one search of the index,
+    //in place on newVec
+    CoverTreePoint p((EmbedSpan(newVec)));
+    auto nearestDist = [&]() {
+        return p.distance(CoverTreePoint(aE, index.kNearest(p,1)[0]));
+    };
+    double dist = nearestDist();
     for (unsigned int i=0; i<numDims; i++) {
-        CoverTreePoint p1(Handle::UNDEFINED,newVec);
         newVec[i]=embedVec2[i];
-        CoverTreePoint p2(Handle::UNDEFINED,newVec);
-        double dist1 = p1.distance(cTree.k_nearest_neighbors(p1,1)[0]);
-        double dist2 = p2.distance(cTree.k_nearest_neighbors(p2,1)[0]);
-        if (dist1>dist2) newVec[i]=embedVec2[i];
+        double newDist = nearestDist();
+        if (dist>newDist) newVec[i]=embedVec2[i];
+        dist = newDist;
     }
+    return newVec;
+}
+
+Handle DimEmbedModule::blendNodes(Handle n1,
+                                  Handle n2, Type l)
+{
+    std::vector<double> newVec = blendVector(n1, n2, l);
+    const HandleSeq& pivots = getPivots(l);
+    const unsigned int numDims = (unsigned int) dimensionMap[l];
+    OC_ASSERT(numDims==newVec.size() && numDims==pivots.size());
     std::string prefix("blend_"+n1->to_string()+"_"+n2->to_string()+"_");
+    //The embedding takes in the node and its links at once
+    AtomBatch batch(*this);
     Handle newNode = add_prefixed_node(*as, n1->get_type(), prefix);
-
     for (unsigned int i=0; i<numDims; i++) {
         double strength = sqrt(newVec[i]);
         TruthValuePtr tv(SimpleTruthValue::createTV(strength, strength));
         Handle hi = as->add_link(l, newNode, pivots[i]);
         hi->setTruthValue(hi->getTruthValue()->merge(tv));
     }
+    batch.end();
     return newNode;
 }
 
 double DimEmbedModule::euclidDist(double v1[], double v2[], int size)
 {
-    double dist=0;
-    for (int i=0; i<size;++i) {
-        dist += std::pow((v1[i]-v2[i]), 2);
-    }
-    dist = sqrt(dist);
-    return dist;
+    return sqrt(distance_kernels().float64(v1, v2, size));
 }
 
 double DimEmbedModule::euclidDist(Handle h1,
@@ -1050,23 +1773,19 @@ double DimEmbedModule::euclidDist(Handle h1,
                       getEmbedVector(h2, l, fanin));
 }
 
-double DimEmbedModule::euclidDist(const std::vector<double>& v1,
-                                  const std::vector<double>& v2)
+double DimEmbedModule::euclidDist(EmbedSpan v1, EmbedSpan v2)
 {
     OC_ASSERT(v1.size()==v2.size());
-    std::vector<double>::const_iterator it1=v1.begin();
-    std::vector<double>::const_iterator it2=v2.begin();
-
-    double distance=0;
     //Calculate euclidean distance between v1 and v2
-    for (; it1 != v1.end(); ++it1, ++it2)
-        distance+=sq(*it1 - *it2);
-    distance=sqrt(distance);
-    return distance;
+    return sqrt(squared_distance(v1, v2));
 }
 
 void DimEmbedModule::handleAddSignal(Handle h)
 {
+    if (_batchDepth>0) {
+        if (_batchSet.insert(h).second) _batchAtoms.push_back(h);
+        return;
+    }
     AtomEmbedMap::iterator it;
     AsymAtomEmbedMap::iterator it2;
     if (NodeCast(h)) {
@@ -1094,6 +1813,7 @@ void DimEmbedModule::handleAddSignal(Handle h)
 void DimEmbedModule::atomRemoveSignal(AtomPtr atom)
 {
     Handle h = atom->get_handle();
+    _batchSet.erase(h);
     if (NodeCast(atom)) {
         //for each link type embedding that exists, remove the node
         AtomEmbedMap::iterator it;
@@ -1109,6 +1829,11 @@ void DimEmbedModule::atomRemoveSignal(AtomPtr atom)
 
 void DimEmbedModule::TVChangedSignal(Handle h, TruthValuePtr a, TruthValuePtr b)
 {
+    //Applying a batch re-adds its atoms with their final truth values
+    if (_batchDepth>0) {
+        handleAddSignal(h);
+        return;
+    }
 	atomRemoveSignal(h);
 	handleAddSignal(h);
 }
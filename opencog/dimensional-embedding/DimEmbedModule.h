@@ -25,16 +25,24 @@
 #ifndef _OPENCOG_DIM_EMBED_MODULE_H
 #define _OPENCOG_DIM_EMBED_MODULE_H
 
+#include <functional>
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <opencog/atomspace/AtomSpace.h>
 #include <opencog/attentionbank/bank/AttentionBank.h>
 #include <opencog/cogserver/server/Module.h>
 #include <opencog/cogserver/server/CogServer.h>
-#include <opencog/util/Cover_Tree.h>
 #include "CoverTreePoint.h"
+#include "EmbedGraph.h"
+#include "EmbedIndex.h"
+#include "EmbeddingStore.h"
+#include "KnnCache.h"
+#include "ThreadPool.h"
 
 namespace opencog
 {
@@ -47,9 +55,165 @@ namespace opencog
      */
     class DimEmbedModule : public Module
     {
+    public:
+        /**
+         * Options for embedAtomSpace.
+         */
+        struct EmbedParams
+        {
+            /**
+             * How many pivots to pick at a time. The pivots of a batch are
+             * all picked farthest-first against the pivots committed before
+             * the batch, and their searches run in parallel. 1 gives the
+             * fully serial farthest-first order.
+             */
+            int pivotBatch;
+
+            /**
+             * Spread each single pivot search over the thread pool with
+             * delta-stepping (see DeltaSteppingSearch) instead of running
+             * it on one thread. Worth it when one search over a very large
+             * graph dominates, or when there are few pivots; the embedding
+             * is identical either way.
+             */
+            bool parallelSearch;
+
+            /**
+             * Bucket width for parallelSearch, in -log(weight) units.
+             */
+            double searchDelta;
+
+            /**
+             * How the embedding vectors are stored (see EmbedPrecision).
+             * The compact forms take 2-8 times less memory, and distances
+             * are computed on them directly.
+             */
+            EmbedPrecision precision;
+
+            /**
+             * With a compact precision, also keep the exact vectors and use
+             * them to re-rank the candidates of kNearestNeighbors.
+             */
+            bool exactRerank;
+
+            EmbedParams()
+                : pivotBatch(1), parallelSearch(false), searchDelta(0.1),
+                  precision(EMBED_FLOAT64), exactRerank(false) {}
+        };
+
+        /**
+         * Options for kMeansCluster (and so addKMeansClusters).
+         */
+        struct ClusterParams
+        {
+            /**
+             * 0 runs full k-means iterations over every node. Otherwise
+             * each iteration moves the centroids toward batchSize nodes
+             * drawn at random (see KMeans::setMiniBatch), which costs the
+             * same however many nodes there are; only the final
+             * assignment of the nodes to the clusters reads them all.
+             */
+            std::size_t batchSize;
+
+            /**
+             * With batchSize, the iterations stop once no centroid moves
+             * farther than this in one.
+             */
+            double tolerance;
+
+            /**
+             * addKMeansClusters: once it holds maxClusters clusters, stop
+             * the sweep over k after this many k values in a row add none
+             * (none rates above the worst kept). 0 sweeps every k.
+             */
+            int patience;
+
+            ClusterParams() : batchSize(0), tolerance(1e-3), patience(0) {}
+        };
+
+        /**
+         * Called with each node a radius query finds and its distance to
+         * the query; returns false to end the query there.
+         */
+        typedef std::function<bool(const Handle&, double)> RadiusVisitor;
+
+        /**
+         * Which nodes a filtered kNearestNeighbors may return.
+         */
+        struct NeighborFilter
+        {
+            /**
+             * Node types to keep, each with its subtypes; empty keeps every
+             * type. Checked against per-type row bitmaps of the embedding.
+             */
+            std::vector<Type> types;
+
+            /**
+             * Further condition on the nodes of those types (eg a minimum
+             * STI); empty keeps them all.
+             */
+            std::function<bool(const Handle&)> predicate;
+        };
+
+        /**
+         * The neighbours of a node in increasing distance, handed out a
+         * few at a time (see neighborCursor). The search state is kept
+         * between calls, so the next page costs about as much as its own
+         * size rather than a new search. A cursor goes stale once the
+         * embedding it pages through changes (a node added or removed, the
+         * index rebuilt or replaced), and then throws.
+         */
+        class NodeCursor
+        {
+        public:
+            /**
+             * Sets h to the next nearest node and d to its distance.
+             *
+             * @return false once every node has been handed out.
+             */
+            bool next(Handle& h, double& d);
+
+            /**
+             * Up to n more nodes, nearest first; fewer once the nodes run
+             * out.
+             */
+            HandleSeq next(int n);
+
+            bool isStale() const;
+
+        private:
+            friend class DimEmbedModule;
+            //Only watched, so that a cursor left lying around does not
+            //keep a replaced index alive
+            std::weak_ptr<EmbedIndex> _index;
+            std::shared_ptr<NeighborCursor> _cursor;
+        };
+
+        /**
+         * An atom batch (see beginAtomBatch) open for as long as this
+         * lives. end() closes it, and throws whatever applying it throws;
+         * if it is still open when destroyed (eg by an exception), the
+         * destructor closes it and only logs such an error, so that the
+         * exception in flight is the one that gets through.
+         */
+        class AtomBatch
+        {
+        public:
+            explicit AtomBatch(DimEmbedModule& module);
+            ~AtomBatch();
+            void end();
+
+        private:
+            DimEmbedModule& _module;
+            bool _open;
+
+            AtomBatch(const AtomBatch&);
+            AtomBatch& operator=(const AtomBatch&);
+        };
+
     private:
         AttentionBank* _bank;
-        typedef std::map<Handle, std::vector<double> > AtomEmbedding;
+        typedef EmbeddingStore AtomEmbedding;
         typedef std::map<Type, HandleSeq> PivotMap;
         typedef std::map<Type, std::pair<HandleSeq, HandleSeq> > AsymPivotMap;
         typedef std::map<Type, AtomEmbedding> AtomEmbedMap;
@@ -59,10 +223,9 @@ namespace opencog
         //the second is for (inheritance atom pivot) (ie pivot is target)
         //the "fanin" argument in several functions represents whether the links
         //go "inward", with pivots as targets (ie the second embedding)
-        typedef std::map<Type, CoverTree<CoverTreePoint> > EmbedTreeMap;
-        typedef std::map<Type, std::pair<CoverTree<CoverTreePoint>,
-                                         CoverTree<CoverTreePoint> > >
-            AsymEmbedTreeMap;
+        typedef std::map<Type, EmbedIndexPtr> EmbedIndexMap;
+        typedef std::map<Type, std::pair<EmbedIndexPtr, EmbedIndexPtr> >
+            AsymEmbedIndexMap;
         typedef std::vector<std::pair<HandleSeq,std::vector<double> > >
             ClusterSeq; //the vector of doubles is the centroid of the cluster
         
@@ -75,10 +238,24 @@ namespace opencog
         AsymAtomEmbedMap asymAtomMaps;
         PivotMap pivotsMap;//Pivot atoms which act as the basis
         AsymPivotMap asymPivotsMap;
-        EmbedTreeMap embedTreeMap;
-        AsymEmbedTreeMap asymEmbedTreeMap;
+        EmbedIndexMap embedIndexMap;
+        AsymEmbedIndexMap asymEmbedIndexMap;
+        std::map<Type, EmbedIndexParams> indexParamsMap;//Link types missing
+                                        //here use the default (cover tree)
+        std::map<Type, ClusterParams> clusterParamsMap;
         std::map<Type,int> dimensionMap;//Stores the number of dimensions that
                                         //each link type is embedded under
+        unsigned _numThreads;
+        std::shared_ptr<ThreadPool> _pool;//Created on first use
+        KnnCache _knnCache;//Answers of kNearestNeighbors
+        static const size_t KNN_CACHE_BYTES = 32 << 20;
+
+        typedef std::pair<std::pair<Type, bool>, AtomEmbedding::Row> IndexRow;
+        int _batchDepth;//Open beginAtomBatch calls
+        HandleSeq _batchAtoms;//Atoms waiting for the batch, in order
+        std::set<Handle> _batchSet;//The same (less the removed ones)
+        bool _applyingBatch;
+        std::set<IndexRow> _batchRows;//Out of their index while it applies
 
         /**
          * Adds h as a pivot and adds the distances from each node to
@@ -88,13 +265,161 @@ namespace opencog
          *
          * @param h Handle to be added as a pivot
          * @param linkType Type of link for which h should be added as a pivot
+         * @param graph Snapshot of the linkType subgraph to search; h must be
+         * one of its nodes, and every node of the snapshot gets a new
+         * coordinate.
          * @param fanin For asymmetric link types, we need to embed twice,
          * once with fanin=true and once with fanin=false. The fanin=true
          * embedding of a given node represents the weight of the path
          * starting from the node and going to the pivot.
          */
-        void addPivot(Handle h, Type linkType, bool fanin=false);
-        Handle pickPivot(Type linkType, HandleSeq& nodes, bool fanin=false);
+        void addPivot(Handle h, Type linkType, const EmbedGraph& graph,
+                      bool fanin=false);
+
+        /**
+         * Adds several pivots at once. The searches from each pivot run
+         * concurrently on the module's thread pool (or one after another,
+         * each spread over the pool, if params.parallelSearch is set); the
+         * resulting columns are appended in the order of newPivots.
+         */
+        void addPivots(const HandleSeq& newPivots, Type linkType,
+                       const EmbedGraph& graph, bool fanin=false,
+                       const EmbedParams& params=EmbedParams());
+
+        /**
+         * Records h as a pivot and stores weights (indexed like the nodes
+         * of graph) as the next coordinate of every node.
+         */
+        void commitPivot(Handle h, Type linkType, const EmbedGraph& graph,
+                         const std::vector<double>& weights, bool fanin);
+
+        /**
+         * Picks up to count new pivots from nodes: those farthest from
+         * (ie with the lowest path weight to) their closest existing pivot.
+         * With count=1 this is the classic farthest-first choice.
+         */
+        HandleSeq pickPivots(Type linkType, const HandleSeq& nodes,
+                             size_t count, bool fanin=false);
+
+        /**
+         * Picks and adds numDimensions pivots for one direction of the
+         * embedding of graph's link type.
+         */
+        void embedDirection(Type linkType, const EmbedGraph& graph,
+                            int numDimensions, const EmbedParams& params,
+                            bool fanin);
+
+        /**
+         * For scoreClusters, homogeneity and separation: the requested
+         * scores of each cluster, with a member's nearest clustermates and
+         * outsiders found by labelling the rows of the embedding with
+         * their cluster and filtering index queries by the label.
+         */
+        std::vector<std::pair<double, double> > scoreClusters(
+            const std::vector<const HandleSeq*>& clusters, Type linkType,
+            bool homogeneity, bool separation, ThreadPool* pool) const;
+
+        /**
+         * Runs KMeans over the given rows of aE: numClusters clusters,
+         * the best of npass tries (over the pivots instead, if transpose),
+         * on pool if given, in mini-batches if params say so. Sets
+         * clusterid[i] to the cluster of the ith row (or pivot), and
+         * returns the centroid of each cluster.
+         */
+        std::vector<std::vector<double> > kCluster(
+            const AtomEmbedding& aE,
+            const std::vector<AtomEmbedding::Row>& rows, int numClusters,
+            int npass, bool transpose, std::vector<int>& clusterid,
+            ThreadPool* pool=0,
+            const ClusterParams& params=ClusterParams()) const;
+
+        /**
+         * Makes the nearest neighbour index (as set by setIndexParams) for
+         * the embedding aE of linkType, loaded with every point of aE.
+         */
+        EmbedIndexPtr buildIndex(Type linkType, const AtomEmbedding& aE);
+
+        /**
+         * Builds the indices of linkType's embedding afresh.
+         */
+        void buildIndices(Type linkType);
+
+        /**
+         * How many candidates to ask the index of aE for, to return the k
+         * nearest neighbours. Every k nearest neighbours query asks this
+         * first, so it is where a negative k is rejected (and 0 fetches
+         * nothing).
+         */
+        int fetchCount(const AtomEmbedding& aE, int k) const;
+
+        /**
+         * The handles of rows, the candidate neighbours of row query of
+         * aE; re-ranked on the exact coordinates (keeping k and any tied
+         * with the kth) if aE is compact with an exact copy.
+         */
+        HandleSeq rankNeighbors(const AtomEmbedding& aE,
+                                AtomEmbedding::Row query,
+                                const std::vector<AtomEmbedding::Row>& rows,
+                                int k) const;
+
+        /**
+         * rankNeighbors for a query given by its exact coordinates
+         * (unused unless aE is compact with an exact copy).
+         */
+        HandleSeq rankNeighbors(const AtomEmbedding& aE, EmbedSpan exactQuery,
+                                const std::vector<AtomEmbedding::Row>& rows,
+                                int k) const;
+
+        /**
+         * Returns the embedding a query by a vector of dims coordinates
+         * searches, checking that l is embedded with that many dimensions.
+         */
+        const AtomEmbedding& getQueryEmbedding(Type l, size_t dims,
+                                               bool fanin) const;
+
+        /**
+         * The coordinates of v, a link of NumberNodes.
+         */
+        std::vector<double> getNumberVector(Handle v) const;
+
+        /**
+         * Returns the nearest neighbour index for linkType (and direction,
+         * if linkType is asymmetric). linkType must be embedded.
+         */
+        EmbedIndex& getIndex(Type linkType, bool fanin=false);
+        const EmbedIndex& getIndex(Type linkType, bool fanin=false) const;
+        const EmbedIndexPtr& getIndexPtr(Type linkType, bool fanin=false) const;
+
+        /**
+         * Take row r of linkType's embedding out of its index before the
+         * row changes (or is removed), and put it back after. Every change
+         * to the rows goes through these, so that the kNN cache can drop
+         * the answers the old or the new point could be part of.
+         */
+        void unindexRow(Type linkType, bool fanin, AtomEmbedding::Row r);
+        void indexRow(Type linkType, bool fanin, AtomEmbedding::Row r);
+
+        /**
+         * Puts the rows a batch of atoms changed back in their indices
+         * (see endAtomBatch).
+         */
+        void reindexBatchRows();
+
+        /**
+         * Drops the cached kNN answers row r of linkType's embedding (as
+         * it is now) could be part of.
+         */
+        void forgetNeighborsOf(Type linkType, bool fanin, AtomEmbedding::Row r);
+
+        /**
+         * Returns the AtomEmbedding for linkType (and direction, if
+         * linkType is asymmetric). linkType must be embedded.
+         */
+        AtomEmbedding& getAtomEmbedding(Type linkType, bool fanin=false);
+        const AtomEmbedding& getAtomEmbedding(Type linkType,
+                                              bool fanin=false) const;
+
+        ThreadPool& getThreadPool();
         /**
          * Adds node to the appropriate AtomEmbedding in the AtomEmbedMap.
          *
@@ -114,7 +439,7 @@ namespace opencog
                                     Type linkType);
 
         /**
-         * Removes the node from the AtomEmbedding and Cover Tree for linkType.
+         * Removes the node from the AtomEmbedding and index for linkType.
          *
          * @param h Handle of node to be removed.
          * @param linkType Type for which h is removed from the embedding.
@@ -156,18 +481,18 @@ namespace opencog
         virtual void init();
 
         /**
-         * Returns a vector of doubles corresponding to the handle h's
-         * embedding of link type l. Throws an exception if no embedding
-         * exists yet for type l. Calculates the vector if an embedding exists
-         * (ie pivots are picked) but handle h has not been calculated yet.
+         * Returns a view of the handle h's embedding vector for link
+         * type l. Throws an exception if no embedding exists yet for type
+         * l, or if h is not part of it.
          *
          * @param h The handle whose embedding vector is returned
          * @param l The link type for which h's embedding vector is wanted
          * @param fanin For asymmetric link types.
-         * @return A vector of doubles corresponding to handle h's distance
-         * from each of the pivots.
+         * @return h's distance from each of the pivots. The view points
+         * into the embedding and is only valid until the next node is added
+         * to it; copy it (EmbedSpan::toVector) to keep it longer.
          */
-        const std::vector<double>& getEmbedVector(Handle h, Type l, bool fanin=false) const;
+        EmbedSpan getEmbedVector(Handle h, Type l, bool fanin=false) const;
 
         /**
          * Returns the list of pivots for the embedding of type l.
@@ -191,6 +516,48 @@ namespace opencog
          */
         void embedAtomSpace(Type linkType, int numDimensions=5);
 
+        /**
+         * As above, with the options in params.
+         */
+        void embedAtomSpace(Type linkType, int numDimensions,
+                            const EmbedParams& params);
+
+        /**
+         * Embeds picking pivotBatch pivots at a time and running their
+         * searches in parallel (see EmbedParams::pivotBatch).
+         */
+        void embedAtomSpaceBatched(Type linkType, int numDimensions,
+                                   int pivotBatch);
+
+        /**
+         * Sets the number of threads used by the parallel parts of the
+         * module (0, the default, means one per hardware thread).
+         */
+        void setNumThreads(unsigned numThreads);
+
+        /**
+         * The cache of kNearestNeighbors answers, with its hit and miss
+         * counts. Answers stay cached until a change to the embedding
+         * could affect them; the cache holds 32MB of them by default, and
+         * setCapacity(0) turns it off.
+         */
+        KnnCache& getKnnCache() { return _knnCache; }
+
+        /**
+         * Holds back the embedding updates of the atoms added to the
+         * atomspace (or whose truth value changes) until the matching
+         * endAtomBatch, which applies them together: each atom once, in
+         * the order they came and with its final truth value, and each
+         * row they change leaves its index once and goes back once. Until
+         * then the embedding stays as it was, without the new atoms.
+         * Removed nodes still leave it at once. Batches nest; the
+         * outermost one applies them. An atom whose update throws is
+         * logged and skipped, the rest are still applied, and then
+         * endAtomBatch rethrows the first such error.
+         */
+        void beginAtomBatch();
+        void endAtomBatch();
+
         /**
          * Clears the AtomEmbedMap and PivotMap for linkType, also
          * decreasing the VLTI of any pivots by 1.
@@ -224,8 +591,7 @@ namespace opencog
          * sqrt((a1-a2)^2 + (b1-b2)^2 + ... + (n1-n2)^2)
          */
         double euclidDist(Handle h1, Handle h2, Type l, bool fanin=false);
-        static double euclidDist
-            (const std::vector<double>& v1, const std::vector<double>& v2);
+        static double euclidDist(EmbedSpan v1, EmbedSpan v2);
         static double euclidDist(double v1[], double v2[], int size);
         
         /**
@@ -242,6 +608,160 @@ namespace opencog
          */
         HandleSeq kNearestNeighbors(Handle h, Type l, int k, bool fanin=false);
 
+        /**
+         * The k nearest nodes to h that pass filter. The filter is applied
+         * while the index is searched, so nodes it rejects (eg the
+         * cluster_ and blend_ nodes this module makes) never crowd out the
+         * others, and no second search with a larger k is needed.
+         */
+        HandleSeq kNearestNeighborsFiltered(Handle h, Type l, int k,
+                                            const NeighborFilter& filter,
+                                            bool fanin=false);
+
+        /**
+         * kNearestNeighborsFiltered for the scheme shell: among the nodes
+         * of type nodeType (or a subtype; Node for any) whose STI is at
+         * least minSTI.
+         */
+        HandleSeq kNNFiltered(Handle h, Type l, int k, Type nodeType,
+                              double minSTI, bool fanin=false);
+
+        /**
+         * kNearestNeighbors for each of hs, with the checks done once and
+         * the searches spread over the thread pool.
+         *
+         * @return The neighbours of each of hs, in the same order.
+         */
+        std::vector<HandleSeq> kNearestNeighborsBatch(const HandleSeq& hs,
+                                                      Type l, int k,
+                                                      bool fanin=false);
+
+        /**
+         * kNearestNeighborsBatch for the scheme shell: the neighbours of
+         * each of hs (starting with itself) in a ListLink, in the same
+         * order as hs.
+         */
+        HandleSeq kNNBatchLinks(const HandleSeq& hs, Type l, int k,
+                                bool fanin=false);
+
+        /**
+         * Calls visit(n, d) for every node n within distance r of h for
+         * link type l (h itself included), d being euclidDist(h, n, l).
+         * The nodes are handed over as the index finds them, in no
+         * particular order, so even a large neighbourhood is never held
+         * in memory; visit returns false to stop early.
+         */
+        void forEachWithinRadius(Handle h, Type l, double r,
+                                 const RadiusVisitor& visit,
+                                 bool fanin=false);
+
+        /**
+         * forEachWithinRadius around the point v of the embedding space of
+         * l (with one coordinate per pivot) rather than a node.
+         */
+        void forEachWithinRadius(const std::vector<double>& v, Type l,
+                                 double r, const RadiusVisitor& visit,
+                                 bool fanin=false);
+
+        /**
+         * The nodes within distance r of h for link type l, nearest first.
+         */
+        HandleSeq withinRadius(Handle h, Type l, double r, bool fanin=false);
+
+        /**
+         * The k nearest nodes to the point v of the embedding space of l
+         * (one coordinate per pivot, eg a centroid from kMeansCluster),
+         * nearest first, with any tied with the kth. v is searched for in
+         * place, through the same index as kNearestNeighbors.
+         */
+        HandleSeq kNearestToVector(const std::vector<double>& v, Type l, int k,
+                                   bool fanin=false);
+
+        /**
+         * kNearestToVector for each of vs, with the checks done once and
+         * the searches spread over the thread pool.
+         *
+         * @return The neighbours of each of vs, in the same order.
+         */
+        std::vector<HandleSeq> kNearestToVectors(
+            const std::vector<std::vector<double> >& vs, Type l, int k,
+            bool fanin=false);
+
+        /**
+         * kNearestToVector for the scheme shell, v being a link (eg a
+         * ListLink) of one NumberNode per pivot.
+         */
+        HandleSeq kNNVector(Handle v, Type l, int k, bool fanin=false);
+
+        /**
+         * kNearestToVectors for the scheme shell: the neighbours of each
+         * of vs (links of NumberNodes) in a ListLink, in the same order.
+         */
+        HandleSeq kNNVectorBatch(const HandleSeq& vs, Type l, int k,
+                                 bool fanin=false);
+
+        /**
+         * A cursor over the nodes embedded for link type l in increasing
+         * distance from h (h itself first), for paging through neighbours
+         * without repeating the search for each page. The cover tree is
+         * walked incrementally, and the inverted file opens its cells
+         * nearest first, so both hand out every node in order of the
+         * stored coordinates, as does the flat scan; over an HNSW graph
+         * the cursor fetches pages of doubling size, each in order.
+         */
+        NodeCursor neighborCursor(Handle h, Type l, bool fanin=false);
+
+        /**
+         * Chooses the nearest neighbour index kNearestNeighbors searches
+         * for link type l: the exact cover tree (the default), an exact
+         * brute force scan, which answers large batches of queries
+         * fastest, an approximate HNSW graph, which stays fast at 50 and
+         * more dimensions, or an approximate inverted file over k-means
+         * clusters, which reads only a few clusters per query. Takes
+         * effect at once if l is embedded (the index is rebuilt), and
+         * otherwise at the next embedAtomSpace.
+         */
+        void setIndexParams(Type l, const EmbedIndexParams& params);
+        const EmbedIndexParams& getIndexParams(Type l) const;
+
+        /**
+         * Searches link type l by brute force (see FlatIndex). For the
+         * scheme shell.
+         */
+        void useFlatIndex(Type l);
+
+        /**
+         * Searches link type l with an HNSW graph with the given settings
+         * (see EmbedIndexParams). For the scheme shell.
+         */
+        void useHnswIndex(Type l, int M, int efConstruction, int efSearch);
+
+        /**
+         * Searches link type l with an inverted file index over numCells
+         * k-means clusters of the embedding, scanning the nprobe nearest
+         * clusters per query (0 keeps the default of either). For the
+         * scheme shell.
+         */
+        void useIvfIndex(Type l, int numCells, int nprobe);
+
+        /**
+         * Rebuilds the nearest neighbour index of link type l from the
+         * current embedding. Indices follow nodes as they come and go, but
+         * an IVF index keeps the clusters it was built with until then;
+         * call this (eg on a schedule) to re-cluster it.
+         */
+        void rebuildIndex(Type l);
+
+        /**
+         * Measures the recall@k of the index of link type l: the fraction
+         * of the true k nearest neighbours (from an exact cover tree) that
+         * it returns, averaged over numQueries embedded nodes spread over
+         * the embedding. Also logs the time per query of both searches, to
+         * tune recall against latency. 1 for the exact default index.
+         */
+        double measureRecall(Type l, int k, int numQueries=100,
+                             bool fanin=false);
+
         /**
          * Use k-means clustering to find clusters using the
          * dimensional embedding. This function won't actually add
@@ -253,6 +773,10 @@ namespace opencog
          * @param nPasses The number of times to try clustering (there is
          * a stochastic component to k-means clustering, so the clustering
          * may be slightly different each time).
+         * @param pivotWise Cluster the pivots (by the coordinates of the
+         * nodes along each) instead of the nodes.
+         *
+         * Clusters in mini-batches if setClusterParams says so for l.
          * @return A vector of (HandleSeq,vector<double>) pairs, where
          * each HandleSeq represents a cluster and the vector of doubles its
          * centroid.
@@ -260,18 +784,29 @@ namespace opencog
         ClusterSeq kMeansCluster(Type l, int numClusters, int nPasses=1, bool pivotWise=false);
 
         /**
-         * Use k-means clustering to add new nodes to the atomspace (one
-         * new node for each good cluster found, plus inheritance links
-         * between each new node and its corresponding cluster members).
+         * Sets how kMeansCluster clusters link type l.
+         */
+        void setClusterParams(Type l, const ClusterParams& params);
+        const ClusterParams& getClusterParams(Type l) const;
+
+        /**
+         * Makes kMeansCluster use mini-batches of batchSize nodes for link
+         * type l (0 goes back to full iterations), stopping at the given
+         * tolerance (0 keeps the current one). For the scheme shell.
+         */
+        void useMiniBatchKMeans(Type l, int batchSize, double tolerance);
+
+        /**
+         * Sweeps k-means clustering over a range of k for the best
+         * clusters of link type l, without changing the atomspace.
          *
-         * This will add up to maxClusters new clusters, choosing those
+         * This will find up to maxClusters clusters, choosing those
          * clusters which maximize homogeneity*separation.
          *
          * @param l Type of link for which to find clusters.
-         * @param maxClusters The maximum number of nodes to add to the
-         * atomspace.
+         * @param maxClusters The maximum number of clusters to return.
          * @param threshold The threshold for accepting a cluster; clusters
-         * not meeting this threshold will not be added to the atomspace.
+         * not meeting this threshold will not be returned.
          * Cluster quality is measured as homogeneity*separation (see the
          * homogeneity and separation functions for further explanation).
          * @param kPasses The number of different k values to try for
@@ -280,6 +815,25 @@ namespace opencog
          * Then for kPasses=1, the k value is 2^(n/2). For
          * kPasses=2, the k values are 2^(n/3) and 2^(2n/3). For
          * kPasses=3, the k values are 2^(n/4), 2^(2n/4), and 2^(3n/4).
+         *
+         * Each k value is clustered and scored on the whole thread pool
+         * in turn; when there are too few nodes for that, the k values
+         * run at once instead, one per thread (in waves of the pool's size
+         * with a patience set by setClusterParams). Either way they are
+         * merged in the order above, so the clusters found are those of a
+         * serial sweep.
+         * @return The clusters found, from the least to the best rated.
+         */
+        ClusterSeq findKMeansClusters(Type l, int maxClusters,
+                                      double threshold=0., int kPasses=-1);
+
+        /**
+         * Use k-means clustering to add new nodes to the atomspace (one
+         * new node for each good cluster found, plus inheritance links
+         * between each new node and its corresponding cluster members).
+         *
+         * The clusters are those of findKMeansClusters, with the same
+         * parameters.
          */
         void addKMeansClusters(Type l, int maxClusters,
                                double threshold=0., int kPasses=-1);
@@ -301,12 +855,33 @@ namespace opencog
          */
         double separation(const HandleSeq& cluster, Type linkType) const;
 
+        /**
+         * The homogeneity and separation of each of clusters (which must
+         * not share nodes), as addKMeansClusters rates them. Each member
+         * asks the nearest neighbour index of linkType for its nearest
+         * clustermate and its nearest node of any other cluster (or none),
+         * every member of every cluster at once on the thread pool. Exact
+         * with an exact index, and as good as its recall otherwise. A
+         * singleton has homogeneity 0.
+         */
+        std::vector<std::pair<double, double> >
+        scoreClusters(const ClusterSeq& clusters, Type linkType);
+
         /**
          * Create a new node by blending the two existing nodes, n1 and n2,
-         * based on their embeddings for link type l.
+         * based on their embeddings for link type l. The blend walks from
+         * n1's vector to n2's one pivot at a time, measuring its distance
+         * to the nearest node at each step; every coordinate ends up as
+         * n2's, so the new node gets n2's vector.
          */
         Handle blendNodes(Handle n1, Handle n2, Type l);
 
+        /**
+         * The vector blendNodes(n1, n2, l) gives its new node, as the
+         * strengths (squared) of its links to the pivots.
+         */
+        std::vector<double> blendVector(Handle n1, Handle n2, Type l) const;
+
         void printEmbedding();
 
         /**
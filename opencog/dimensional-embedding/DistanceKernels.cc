@@ -0,0 +1,552 @@
+/*
+ * opencog/dimensional-embedding/DistanceKernels.cc
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <algorithm>
+#include <cstring>
+
+#include <opencog/util/numeric.h>
+#include <opencog/util/exceptions.h>
+
+#include "DistanceKernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DIM_EMBED_X86_KERNELS 1
+// Some versions of gcc warn about the "undefined" registers their own
+// AVX-512 intrinsics start from
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#endif
+
+using namespace opencog;
+
+// Fully unrolls the vector loops of the fixed length kernels (the generic
+// ones get unrolled as far, with a remainder loop)
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+#define DIM_EMBED_UNROLL _Pragma("GCC unroll 16")
+#else
+#define DIM_EMBED_UNROLL
+#endif
+
+static const double FIXED16_SCALE = 1.0 / (65535.0 * 65535.0);
+
+// The compact kernels accumulate in float (or exactly, in integers): the
+// coordinates they start from carry less precision than that anyway.
+
+template<std::size_t N>
+static double scalar_float64(const double* a, const double* b, std::size_t n)
+{
+    if (N) n = N;
+    double dist = 0;
+    for (std::size_t i = 0; i < n; ++i) dist += sq(a[i] - b[i]);
+    return dist;
+}
+
+template<std::size_t N>
+static double scalar_float32(const float* a, const float* b, std::size_t n)
+{
+    if (N) n = N;
+    float dist = 0;
+    for (std::size_t i = 0; i < n; ++i) dist += sq(a[i] - b[i]);
+    return dist;
+}
+
+template<std::size_t N>
+static double scalar_fixed16(const uint16_t* a, const uint16_t* b,
+                             std::size_t n)
+{
+    if (N) n = N;
+    uint64_t dist = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        int64_t d = (int64_t) a[i] - (int64_t) b[i];
+        dist += (uint64_t) (d * d);
+    }
+    return dist * FIXED16_SCALE;
+}
+
+template<std::size_t N>
+static double scalar_quant8(const uint8_t* a, const uint8_t* b,
+                            const float* steps, std::size_t n)
+{
+    if (N) n = N;
+    float dist = 0;
+    for (std::size_t i = 0; i < n; ++i)
+        dist += sq(((int) a[i] - (int) b[i]) * steps[i]);
+    return dist;
+}
+
+#ifdef DIM_EMBED_X86_KERNELS
+
+// ---------------------------------------------------------------- SSE4.2
+
+template<std::size_t N>
+__attribute__((target("sse4.2")))
+static double sse42_float64(const double* a, const double* b, std::size_t n)
+{
+    if (N) n = N;
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    std::size_t i = 0;
+    DIM_EMBED_UNROLL
+    for (; i < n - n % 4; i += 4) {
+        __m128d d0 = _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+        __m128d d1 = _mm_sub_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2));
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+    }
+    acc0 = _mm_add_pd(acc0, acc1);
+    double dist = _mm_cvtsd_f64(_mm_add_pd(acc0, _mm_unpackhi_pd(acc0, acc0)));
+    for (; i < n; ++i) dist += sq(a[i] - b[i]);
+    return dist;
+}
+
+__attribute__((target("sse4.2")))
+static float sse42_hsum(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+template<std::size_t N>
+__attribute__((target("sse4.2")))
+static double sse42_float32(const float* a, const float* b, std::size_t n)
+{
+    if (N) n = N;
+    __m128 acc = _mm_setzero_ps();
+    std::size_t i = 0;
+    DIM_EMBED_UNROLL
+    for (; i < n - n % 4; i += 4) {
+        __m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        acc = _mm_add_ps(acc, _mm_mul_ps(d, d));
+    }
+    float dist = sse42_hsum(acc);
+    for (; i < n; ++i) dist += sq(a[i] - b[i]);
+    return dist;
+}
+
+template<std::size_t N>
+__attribute__((target("sse4.2")))
+static double sse42_fixed16(const uint16_t* a, const uint16_t* b,
+                            std::size_t n)
+{
+    if (N) n = N;
+    __m128 acc = _mm_setzero_ps();
+    std::size_t i = 0;
+    DIM_EMBED_UNROLL
+    for (; i < n - n % 4; i += 4) {
+        __m128i x = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*) (a + i)));
+        __m128i y = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*) (b + i)));
+        __m128 d = _mm_cvtepi32_ps(_mm_sub_epi32(x, y));
+        acc = _mm_add_ps(acc, _mm_mul_ps(d, d));
+    }
+    double dist = sse42_hsum(acc);
+    for (; i < n; ++i) dist += sq((double) a[i] - (double) b[i]);
+    return dist * FIXED16_SCALE;
+}
+
+template<std::size_t N>
+__attribute__((target("sse4.2")))
+static double sse42_quant8(const uint8_t* a, const uint8_t* b,
+                           const float* steps, std::size_t n)
+{
+    if (N) n = N;
+    __m128 acc = _mm_setzero_ps();
+    std::size_t i = 0;
+    DIM_EMBED_UNROLL
+    for (; i < n - n % 4; i += 4) {
+        int32_t xa, xb;
+        std::memcpy(&xa, a + i, 4);
+        std::memcpy(&xb, b + i, 4);
+        __m128i x = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(xa));
+        __m128i y = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(xb));
+        __m128 d = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x, y)),
+                              _mm_loadu_ps(steps + i));
+        acc = _mm_add_ps(acc, _mm_mul_ps(d, d));
+    }
+    float dist = sse42_hsum(acc);
+    for (; i < n; ++i) dist += sq(((int) a[i] - (int) b[i]) * steps[i]);
+    return dist;
+}
+
+// ------------------------------------------------------------------ AVX2
+
+// The wide kernels clear the upper register halves before returning, as
+// the compiler does not always do so at low optimization levels, and the
+// SSE code that runs next would otherwise pay for the transition.
+
+__attribute__((target("avx2,fma")))
+static float avx2_hsum(__m256 v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+template<std::size_t N>
+__attribute__((target("avx2,fma")))
+static double avx2_float64(const double* a, const double* b, std::size_t n)
+{
+    if (N) n = N;
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    std::size_t i = 0;
+    DIM_EMBED_UNROLL
+    for (; i < n - n % 8; i += 8) {
+        __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+        __m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(a + i + 4),
+                                   _mm256_loadu_pd(b + i + 4));
+        acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+        acc1 = _mm256_fmadd_pd(d1, d1, acc1);
+    }
+    DIM_EMBED_UNROLL
+    for (; i < n - n % 4; i += 4) {
+        __m256d d = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+        acc0 = _mm256_fmadd_pd(d, d, acc0);
+    }
+    acc0 = _mm256_add_pd(acc0, acc1);
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(acc0),
+                           _mm256_extractf128_pd(acc0, 1));
+    double dist = _mm_cvtsd_f64(_mm_add_pd(s, _mm_unpackhi_pd(s, s)));
+    _mm256_zeroupper();
+    for (; i < n; ++i) dist += sq(a[i] - b[i]);
+    return dist;
+}
+
+template<std::size_t N>
+__attribute__((target("avx2,fma")))
+static double avx2_float32(const float* a, const float* b, std::size_t n)
+{
+    if (N) n = N;
+    __m256 acc = _mm256_setzero_ps();
+    std::size_t i = 0;
+    DIM_EMBED_UNROLL
+    for (; i < n - n % 8; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        acc = _mm256_fmadd_ps(d, d, acc);
+    }
+    float dist = avx2_hsum(acc);
+    _mm256_zeroupper();
+    for (; i < n; ++i) dist += sq(a[i] - b[i]);
+    return dist;
+}
+
+template<std::size_t N>
+__attribute__((target("avx2,fma")))
+static double avx2_fixed16(const uint16_t* a, const uint16_t* b, std::size_t n)
+{
+    if (N) n = N;
+    __m256 acc = _mm256_setzero_ps();
+    std::size_t i = 0;
+    DIM_EMBED_UNROLL
+    for (; i < n - n % 8; i += 8) {
+        __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) (a + i)));
+        __m256i y = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) (b + i)));
+        __m256 d = _mm256_cvtepi32_ps(_mm256_sub_epi32(x, y));
+        acc = _mm256_fmadd_ps(d, d, acc);
+    }
+    double dist = avx2_hsum(acc);
+    _mm256_zeroupper();
+    for (; i < n; ++i) dist += sq((double) a[i] - (double) b[i]);
+    return dist * FIXED16_SCALE;
+}
+
+template<std::size_t N>
+__attribute__((target("avx2,fma")))
+static double avx2_quant8(const uint8_t* a, const uint8_t* b,
+                          const float* steps, std::size_t n)
+{
+    if (N) n = N;
+    __m256 acc = _mm256_setzero_ps();
+    std::size_t i = 0;
+    DIM_EMBED_UNROLL
+    for (; i < n - n % 8; i += 8) {
+        __m256i x = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (a + i)));
+        __m256i y = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (b + i)));
+        __m256 d = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(x, y)),
+                                 _mm256_loadu_ps(steps + i));
+        acc = _mm256_fmadd_ps(d, d, acc);
+    }
+    float dist = avx2_hsum(acc);
+    _mm256_zeroupper();
+    for (; i < n; ++i) dist += sq(((int) a[i] - (int) b[i]) * steps[i]);
+    return dist;
+}
+
+// --------------------------------------------------------------- AVX-512
+
+// Every AVX-512 CPU also has AVX2, which finishes the rows of the compact
+// forms that do not fill a whole 16-lane block.
+
+template<std::size_t N>
+__attribute__((target("avx512f")))
+static double avx512_float64(const double* a, const double* b, std::size_t n)
+{
+    if (N) n = N;
+    __m512d acc = _mm512_setzero_pd();
+    std::size_t i = 0;
+    DIM_EMBED_UNROLL
+    for (; i < n - n % 8; i += 8) {
+        __m512d d = _mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i));
+        acc = _mm512_fmadd_pd(d, d, acc);
+    }
+    if (i < n) {
+        //The last partial block, with the missing lanes masked to 0
+        __mmask8 m = (__mmask8) ((1u << (n - i)) - 1);
+        __m512d d = _mm512_sub_pd(_mm512_maskz_loadu_pd(m, a + i),
+                                  _mm512_maskz_loadu_pd(m, b + i));
+        acc = _mm512_fmadd_pd(d, d, acc);
+    }
+    double dist = _mm512_reduce_add_pd(acc);
+    _mm256_zeroupper();
+    return dist;
+}
+
+template<std::size_t N>
+__attribute__((target("avx512f")))
+static double avx512_float32(const float* a, const float* b, std::size_t n)
+{
+    if (N) n = N;
+    __m512 acc = _mm512_setzero_ps();
+    std::size_t i = 0;
+    DIM_EMBED_UNROLL
+    for (; i < n - n % 16; i += 16) {
+        __m512 d = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        acc = _mm512_fmadd_ps(d, d, acc);
+    }
+    if (i < n) {
+        __mmask16 m = (__mmask16) ((1u << (n - i)) - 1);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, a + i),
+                                 _mm512_maskz_loadu_ps(m, b + i));
+        acc = _mm512_fmadd_ps(d, d, acc);
+    }
+    double dist = _mm512_reduce_add_ps(acc);
+    _mm256_zeroupper();
+    return dist;
+}
+
+template<std::size_t N>
+__attribute__((target("avx512f")))
+static double avx512_fixed16(const uint16_t* a, const uint16_t* b,
+                             std::size_t n)
+{
+    if (N) n = N;
+    __m512 acc = _mm512_setzero_ps();
+    std::size_t i = 0;
+    DIM_EMBED_UNROLL
+    for (; i < n - n % 16; i += 16) {
+        __m512i x = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*) (a + i)));
+        __m512i y = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*) (b + i)));
+        __m512 d = _mm512_cvtepi32_ps(_mm512_sub_epi32(x, y));
+        acc = _mm512_fmadd_ps(d, d, acc);
+    }
+    double dist = _mm512_reduce_add_ps(acc) * FIXED16_SCALE;
+    _mm256_zeroupper();
+    if (i < n) dist += avx2_fixed16<N % 16>(a + i, b + i, n - i);
+    return dist;
+}
+
+template<std::size_t N>
+__attribute__((target("avx512f")))
+static double avx512_quant8(const uint8_t* a, const uint8_t* b,
+                            const float* steps, std::size_t n)
+{
+    if (N) n = N;
+    __m512 acc = _mm512_setzero_ps();
+    std::size_t i = 0;
+    DIM_EMBED_UNROLL
+    for (; i < n - n % 16; i += 16) {
+        __m512i x = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*) (a + i)));
+        __m512i y = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*) (b + i)));
+        __m512 d = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_sub_epi32(x, y)),
+                                 _mm512_loadu_ps(steps + i));
+        acc = _mm512_fmadd_ps(d, d, acc);
+    }
+    float dist = _mm512_reduce_add_ps(acc);
+    _mm256_zeroupper();
+    if (i < n) dist += avx2_quant8<N % 16>(a + i, b + i, steps + i, n - i);
+    return dist;
+}
+
+#endif // DIM_EMBED_X86_KERNELS
+
+// The kernels of one instruction set level for rows of exactly N
+// coordinates, with every loop bound known at compile time; N == 0 gives
+// the kernels for any length.
+template<std::size_t N>
+static const DistanceKernels& isa_kernels(DistanceIsa isa)
+{
+    static const DistanceKernels scalar = {
+        "scalar", scalar_float64<N>, scalar_float32<N>, scalar_fixed16<N>,
+        scalar_quant8<N>
+    };
+#ifdef DIM_EMBED_X86_KERNELS
+    static const DistanceKernels sse42 = {
+        "sse4.2", sse42_float64<N>, sse42_float32<N>, sse42_fixed16<N>,
+        sse42_quant8<N>
+    };
+    static const DistanceKernels avx2 = {
+        "avx2", avx2_float64<N>, avx2_float32<N>, avx2_fixed16<N>,
+        avx2_quant8<N>
+    };
+    static const DistanceKernels avx512 = {
+        "avx512", avx512_float64<N>, avx512_float32<N>, avx512_fixed16<N>,
+        avx512_quant8<N>
+    };
+    switch (isa) {
+    case DIST_SSE42: return sse42;
+    case DIST_AVX2: return avx2;
+    case DIST_AVX512: return avx512;
+    default: break;
+    }
+#endif
+    return scalar;
+}
+
+bool opencog::cpu_supports(DistanceIsa isa)
+{
+    switch (isa) {
+    case DIST_SCALAR:
+        return true;
+#ifdef DIM_EMBED_X86_KERNELS
+    case DIST_SSE42:
+        return __builtin_cpu_supports("sse4.2");
+    case DIST_AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case DIST_AVX512:
+        return __builtin_cpu_supports("avx512f") && cpu_supports(DIST_AVX2);
+#endif
+    default:
+        return false;
+    }
+}
+
+const DistanceKernels& opencog::get_distance_kernels(DistanceIsa isa)
+{
+    OC_ASSERT(cpu_supports(isa));
+    return isa_kernels<0>(isa);
+}
+
+const DistanceKernels& opencog::get_distance_kernels(DistanceIsa isa,
+                                                     std::size_t dims)
+{
+    OC_ASSERT(cpu_supports(isa));
+    switch (dims) {
+    case 8: return isa_kernels<8>(isa);
+    case 16: return isa_kernels<16>(isa);
+    case 32: return isa_kernels<32>(isa);
+    case 56: return isa_kernels<56>(isa);
+    case 64: return isa_kernels<64>(isa);
+    default: return isa_kernels<0>(isa);
+    }
+}
+
+static DistanceIsa select_isa()
+{
+#ifdef DIM_EMBED_X86_KERNELS
+    //This runs from a static initializer, maybe before the one that
+    //fills in what __builtin_cpu_supports reads
+    __builtin_cpu_init();
+#endif
+    const DistanceIsa best[] = {DIST_AVX512, DIST_AVX2, DIST_SSE42};
+    for (DistanceIsa isa : best)
+        if (cpu_supports(isa)) return isa;
+    return DIST_SCALAR;
+}
+
+// Picked while the library is loaded, so the hot paths only follow a
+// pointer.
+static const DistanceIsa active_isa = select_isa();
+static const DistanceKernels* active_kernels = &isa_kernels<0>(active_isa);
+
+const DistanceKernels& opencog::distance_kernels()
+{
+    return *active_kernels;
+}
+
+const DistanceKernels& opencog::distance_kernels(std::size_t dims)
+{
+    return get_distance_kernels(active_isa, dims);
+}
+
+// Calls the kernel for the (shared) precision of a and b on coordinates
+// [begin,end); returns false if they are not stored the same way.
+static bool kernel_distance(const DistanceKernels& k, const EmbedSpan& a,
+                            const EmbedSpan& b, std::size_t begin,
+                            std::size_t end, double& dist)
+{
+    if (a.getPrecision() != b.getPrecision()) return false;
+    const std::size_t n = end - begin;
+    switch (a.getPrecision()) {
+    case EMBED_FLOAT32:
+        dist = k.float32(static_cast<const float*>(a.rawData()) + begin,
+                         static_cast<const float*>(b.rawData()) + begin, n);
+        return true;
+    case EMBED_FIXED16:
+        dist = k.fixed16(static_cast<const uint16_t*>(a.rawData()) + begin,
+                         static_cast<const uint16_t*>(b.rawData()) + begin, n);
+        return true;
+    case EMBED_QUANT8:
+        //Only rows of one store share their steps
+        if (a.getSteps() != b.getSteps()) return false;
+        dist = k.quant8(static_cast<const uint8_t*>(a.rawData()) + begin,
+                        static_cast<const uint8_t*>(b.rawData()) + begin,
+                        a.getSteps() + begin, n);
+        return true;
+    default:
+        dist = k.float64(a.doubles() + begin, b.doubles() + begin, n);
+        return true;
+    }
+}
+
+// For mixed forms (eg a compact row against a query vector)
+static double decoded_distance(const EmbedSpan& a, const EmbedSpan& b,
+                               std::size_t begin, std::size_t end)
+{
+    double dist = 0;
+    for (std::size_t i = begin; i < end; ++i) dist += sq(a[i] - b[i]);
+    return dist;
+}
+
+double opencog::squared_distance(const EmbedSpan& a, const EmbedSpan& b)
+{
+    double dist;
+    if (kernel_distance(*active_kernels, a, b, 0, a.size(), dist)) return dist;
+    return decoded_distance(a, b, 0, a.size());
+}
+
+double opencog::squared_distance_bounded(const EmbedSpan& a,
+                                         const EmbedSpan& b, double bound)
+{
+    const DistanceKernels& k = *active_kernels;
+    double dist = 0;
+    const std::size_t step = DISTANCE_BOUND_BLOCK;
+    for (std::size_t begin = 0; begin < a.size(); begin += step) {
+        std::size_t end = std::min(a.size(), begin + step);
+        double block;
+        if (!kernel_distance(k, a, b, begin, end, block))
+            block = decoded_distance(a, b, begin, end);
+        dist += block;
+        if (dist > bound) break;
+    }
+    return dist;
+}
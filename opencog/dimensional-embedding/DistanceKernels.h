@@ -0,0 +1,116 @@
+/*
+ * opencog/dimensional-embedding/DistanceKernels.h
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_DISTANCE_KERNELS_H
+#define _OPENCOG_DISTANCE_KERNELS_H
+
+#include <cstddef>
+#include <stdint.h>
+
+#include "EmbeddingStore.h"
+
+namespace opencog
+{
+    /**
+     * Instruction set levels the distance kernels are built for. All but
+     * DIST_SCALAR are x86 only.
+     */
+    enum DistanceIsa
+    {
+        DIST_SCALAR,
+        DIST_SSE42,
+        DIST_AVX2,     //with FMA
+        DIST_AVX512    //AVX-512F
+    };
+
+    /**
+     * One set of squared euclidean distance kernels, one per
+     * EmbedPrecision. Each returns the squared distance between the n
+     * coordinates at a and b, decoded as EmbedSpan does.
+     */
+    struct DistanceKernels
+    {
+        const char* name;
+        double (*float64)(const double* a, const double* b, std::size_t n);
+        double (*float32)(const float* a, const float* b, std::size_t n);
+        double (*fixed16)(const uint16_t* a, const uint16_t* b, std::size_t n);
+        double (*quant8)(const uint8_t* a, const uint8_t* b,
+                         const float* steps, std::size_t n);
+    };
+
+    /**
+     * True if this build has kernels for isa and the CPU can run them.
+     */
+    bool cpu_supports(DistanceIsa isa);
+
+    /**
+     * The kernels for isa, which must be supported (see cpu_supports).
+     */
+    const DistanceKernels& get_distance_kernels(DistanceIsa isa);
+
+    /**
+     * As get_distance_kernels(isa), but specialized for rows of exactly
+     * dims coordinates: the kernels ignore their n argument and are fully
+     * unrolled. Specializations exist for the padded row lengths of the
+     * usual embedding sizes (8, 16, 32, 50 and 64, see
+     * EmbeddingStore::getPaddedDimensions); for other lengths this returns
+     * the generic kernels.
+     */
+    const DistanceKernels& get_distance_kernels(DistanceIsa isa,
+                                                std::size_t dims);
+
+    /**
+     * The kernels for the best instruction set of this CPU, picked once
+     * when the library is loaded.
+     */
+    const DistanceKernels& distance_kernels();
+
+    /**
+     * The kernels for rows of dims coordinates, for the best instruction
+     * set of this CPU.
+     */
+    const DistanceKernels& distance_kernels(std::size_t dims);
+
+    /**
+     * Returns the squared euclidean distance between a and b. When both are
+     * stored the same compact way it is computed on the compact form
+     * directly, without decoding to doubles first.
+     */
+    double squared_distance(const EmbedSpan& a, const EmbedSpan& b);
+
+    /**
+     * As squared_distance, for searches that only care whether a and b are
+     * within bound of each other: the coordinates are summed a block at a
+     * time and the sum so far is returned as soon as it exceeds bound. The
+     * result is exact whenever it is <= bound.
+     */
+    double squared_distance_bounded(const EmbedSpan& a, const EmbedSpan& b,
+                                    double bound);
+
+    /**
+     * Coordinates squared_distance_bounded sums between two checks of the
+     * bound: shorter vectors gain nothing from it.
+     */
+    const std::size_t DISTANCE_BOUND_BLOCK = 16;
+} //namespace
+
+#endif // _OPENCOG_DISTANCE_KERNELS_H
@@ -0,0 +1,693 @@
+/*
+ * opencog/dimensional-embedding/EmbedCoverTree.h
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_EMBED_COVER_TREE_H
+#define _OPENCOG_EMBED_COVER_TREE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <queue>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "ThreadPool.h"
+
+namespace opencog
+{
+    /**
+     * A cover tree over Points (see CoverTreePoint), with the interface of
+     * cogutil's CoverTree plus a bulk build.
+     *
+     * Every point is one node. The children of a node lie within its
+     * cover distance, and get half of it (or less) as their own; inserted
+     * points go down to the deepest node covering them. Each node also
+     * keeps an upper bound on the distance to its farthest descendant,
+     * which is what searches prune on, so results are exact however the
+     * tree was built.
+     *
+     * The nodes live in one flat arena, with the children of each node in
+     * a contiguous block of it, so a search walks through memory instead
+     * of chasing pointers. Each node also holds its distance to its
+     * parent, which bounds its distance to a query from the parent's, and
+     * lets searches skip children without computing anything. Blocks that
+     * fill up move to a bigger one, and freed blocks are kept for reuse,
+     * so inserts and removes seldom allocate. Copying a tree only copies
+     * a few flat vectors, which makes snapshots cheap.
+     *
+     * Point needs a metric distance(const Point&) and operator==.
+     */
+    template<typename Point>
+    class EmbedCoverTree
+    {
+    public:
+        /**
+         * @param maxDist The largest distance there can be between two
+         * points, if known. It is the cover distance of the first point
+         * inserted.
+         */
+        explicit EmbedCoverTree(double maxDist=0)
+            : _maxDist(maxDist), _root(NONE), _size(0) {}
+
+        std::size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+
+        /**
+         * Replaces the contents of the tree with points, building it top
+         * down: the points around each node are grouped greedily, farthest
+         * first, into balls of half the node's radius, and each ball
+         * becomes a child subtree. Much cheaper than inserting the points
+         * one at a time, and the tree is at least as good to search.
+         *
+         * @param pool If given, the upper levels are split until there are
+         * enough subtrees to keep its threads busy, and the subtrees are
+         * then built in parallel. The tree has the same shape either way.
+         */
+        void build(const std::vector<Point>& points, ThreadPool* pool=0)
+        {
+            _nodes.clear();
+            _free.clear();
+            _root = NONE;
+            _size = points.size();
+            if (points.empty()) return;
+
+            _nodes.reserve(points.size());
+            _root = 0;
+            _nodes.push_back(Node(points[0], _maxDist, 0));
+            std::vector<Member> members(points.size() - 1);
+            for (std::size_t i = 1; i < points.size(); ++i) {
+                members[i-1].point = i;
+                members[i-1].dist = points[i].distance(points[0]);
+            }
+
+            if (!pool || pool->size() < 2 || points.size() < PARALLEL_BUILD) {
+                buildBelow(points, _nodes, _root, members);
+            } else {
+                buildParallel(points, members, *pool);
+            }
+            Node& root = _nodes[_root];
+            root.cover = std::max(root.cover, root.radius);
+        }
+
+        void insert(const Point& p)
+        {
+            ++_size;
+            if (_root == NONE) {
+                _root = allocBlock(1, p);
+                _nodes[_root] = Node(p, _maxDist, 0);
+                return;
+            }
+            Index q = _root;
+            double d = p.distance(_nodes[q].point);
+            //Only the root can be asked to cover a point beyond its
+            //distance; it just covers more from then on
+            if (d > _nodes[q].cover)
+                _nodes[q].cover = std::max(d, 2 * _nodes[q].cover);
+            while (true) {
+                _nodes[q].radius = std::max(_nodes[q].radius, d);
+                //Go down to the nearest child that covers p
+                Index next = NONE;
+                double nextDist = 0;
+                const Node& node = _nodes[q];
+                for (Index c = node.first; c < node.first + node.count; ++c) {
+                    const Node& child = _nodes[c];
+                    //Too far from the parent to be covered by this child
+                    if (std::abs(d - child.parentDist) > child.cover) continue;
+                    double dc = p.distance(child.point);
+                    if (dc <= child.cover && (next == NONE || dc < nextDist)) {
+                        next = c;
+                        nextDist = dc;
+                    }
+                }
+                if (next == NONE) break;
+                q = next;
+                d = nextDist;
+            }
+            addChild(q, Node(p, _nodes[q].cover / 2, d));
+        }
+
+        /**
+         * Removes p if it is in the tree. Its descendants are inserted
+         * again below the rest of the tree.
+         */
+        void remove(const Point& p)
+        {
+            Index parent = NONE;
+            Index found = find(p, parent);
+            if (found == NONE) return;
+
+            std::vector<Point> orphans;
+            std::vector<Index> stack(1, found);
+            while (!stack.empty()) {
+                const Node& node = _nodes[stack.back()];
+                stack.pop_back();
+                for (Index c = node.first; c < node.first + node.count; ++c) {
+                    orphans.push_back(_nodes[c].point);
+                    stack.push_back(c);
+                }
+                freeBlock(node.first, node.capacity);
+            }
+
+            if (parent == NONE) {
+                //Without its root the tree is as good as gone; start over
+                build(orphans);
+                return;
+            }
+            //The last of the siblings takes found's place in the block
+            Node& par = _nodes[parent];
+            Index last = par.first + par.count - 1;
+            if (found != last) _nodes[found] = _nodes[last];
+            --par.count;
+            _size -= 1 + orphans.size();
+            for (const Point& o : orphans) insert(o);
+        }
+
+        /**
+         * The k points nearest to p, nearest first (p itself included, if
+         * it is in the tree). Like cogutil's CoverTree, more than k points
+         * come back if several are tied for kth place.
+         */
+        std::vector<Point> k_nearest_neighbors(const Point& p,
+                                               unsigned k) const
+        {
+            return k_nearest_neighbors(p, k,
+                                       [](const Point&) { return true; });
+        }
+
+        /**
+         * k_nearest_neighbors among the points q for which accept(q) is
+         * true. The others are still walked through, but take no place
+         * among the k, so they do not loosen the pruning.
+         */
+        template<typename Accept>
+        std::vector<Point> k_nearest_neighbors(const Point& p, unsigned k,
+                                               Accept accept) const
+        {
+            std::vector<Point> result;
+            if (k == 0 || _root == NONE) return result;
+
+            //Nodes to visit, most promising (lowest bound) first
+            std::priority_queue<Visit, std::vector<Visit>,
+                                std::greater<Visit> > frontier;
+            //The k best so far, worst on top, and the others tied with
+            //the worst of them
+            std::priority_queue<Candidate> best;
+            std::vector<Candidate> ties;
+
+            double d = p.distance(_nodes[_root].point);
+            frontier.push(Visit(std::max(0.0, d - _nodes[_root].radius),
+                                d, _root));
+            while (!frontier.empty()) {
+                Visit v = frontier.top();
+                if (best.size() == k && beyond(v.bound, best.top().first))
+                    break;
+                frontier.pop();
+
+                Candidate c(v.dist, v.node);
+                if (!accept(_nodes[v.node].point)) {
+                    //Only its descendants are of interest
+                } else if (best.size() < k) {
+                    best.push(c);
+                } else if (c.first == best.top().first) {
+                    ties.push_back(c);
+                } else if (c.first < best.top().first) {
+                    Candidate evicted = best.top();
+                    best.pop();
+                    best.push(c);
+                    if (best.top().first < evicted.first) ties.clear();
+                    else ties.push_back(evicted);
+                }
+                const Node& node = _nodes[v.node];
+                for (Index c = node.first; c < node.first + node.count; ++c) {
+                    const Node& child = _nodes[c];
+                    //The triangle inequality bounds the child's distance
+                    //from its parent's, for free
+                    double lower = std::abs(v.dist - child.parentDist)
+                                   - child.radius;
+                    if (best.size() == k && beyond(lower, best.top().first))
+                        continue;
+                    if (best.size() == k && p.fartherThan(child.point,
+                            best.top().first + child.radius))
+                        continue;
+                    double dc = p.distance(child.point);
+                    double bound = std::max(0.0, dc - child.radius);
+                    if (best.size() < k || !beyond(bound, best.top().first))
+                        frontier.push(Visit(bound, dc, c));
+                }
+            }
+
+            while (!best.empty()) {
+                ties.push_back(best.top());
+                best.pop();
+            }
+            std::sort(ties.begin(), ties.end());
+            for (const Candidate& c : ties)
+                result.push_back(_nodes[c.second].point);
+            return result;
+        }
+
+        /**
+         * Calls visit(q, d) for every point q within distance r of p (p
+         * itself included, if it is in the tree), d being its distance, in
+         * no particular order. Points are handed over as the search finds
+         * them, and visit returns false to stop it there. Subtrees lying
+         * wholly beyond r are skipped, most of them without a distance
+         * computed, by the triangle inequality.
+         *
+         * @return false if visit stopped the search.
+         */
+        template<typename Visitor>
+        bool within_radius(const Point& p, double r, Visitor visit) const
+        {
+            if (_root == NONE) return true;
+            std::vector<std::pair<Index, double> > stack;
+            double d = p.distance(_nodes[_root].point);
+            if (beyond(d - _nodes[_root].radius, r)) return true;
+            stack.push_back(std::make_pair(_root, d));
+            while (!stack.empty()) {
+                Index n = stack.back().first;
+                d = stack.back().second;
+                stack.pop_back();
+                const Node& node = _nodes[n];
+                if (d <= r && !visit(node.point, d)) return false;
+                for (Index c = node.first; c < node.first + node.count; ++c) {
+                    const Node& child = _nodes[c];
+                    if (beyond(std::abs(d - child.parentDist) - child.radius,
+                               r)) continue;
+                    if (p.fartherThan(child.point, r + child.radius))
+                        continue;
+                    double dc = p.distance(child.point);
+                    if (!beyond(dc - child.radius, r))
+                        stack.push_back(std::make_pair(c, dc));
+                }
+            }
+            return true;
+        }
+
+        class NearestIterator;
+
+        /**
+         * The points of the tree in increasing distance from p, handed
+         * out as they are asked for; see NearestIterator.
+         */
+        NearestIterator nearest(const Point& p) const
+        {
+            return NearestIterator(*this, p);
+        }
+
+    private:
+        typedef uint32_t Index;
+        static const Index NONE = 0xffffffff;
+        //Below this many points build() does not bother with threads
+        static const std::size_t PARALLEL_BUILD = 4096;
+
+        struct Node
+        {
+            Point point;
+            double cover;      //children lie within this distance
+            double radius;     //no descendant is farther than this
+            double parentDist; //distance to the parent (0 for the root)
+            Index first;       //the children are nodes [first, first+count)
+            Index count;
+            Index capacity;    //size of the block at first
+
+            Node(const Point& p, double c, double pd)
+                : point(p), cover(c), radius(0), parentDist(pd),
+                  first(0), count(0), capacity(0) {}
+        };
+
+        //A point build() has yet to place, with its distance to the node
+        //it is (so far) grouped under
+        struct Member
+        {
+            std::size_t point;
+            double dist;
+        };
+
+        //A node of build() whose members still need placing below it
+        struct Pending
+        {
+            Index node;
+            std::vector<Member> members;
+        };
+
+        struct Visit
+        {
+            double bound; //no point below node is nearer than this
+            double dist;
+            Index node;
+
+            Visit(double b, double d, Index n) : bound(b), dist(d), node(n) {}
+            bool operator>(const Visit& v) const
+            {
+                return bound > v.bound || (bound == v.bound && node > v.node);
+            }
+        };
+        typedef std::pair<double, Index> Candidate;
+
+        double _maxDist;
+        std::vector<Node> _nodes;
+        //Unused blocks of _nodes, by size class: _free[i] holds blocks of
+        //at least 2^i nodes
+        std::vector<std::vector<Index> > _free;
+        Index _root;
+        std::size_t _size;
+
+        /**
+         * Whether a lower bound rules out a point at distance limit. The
+         * slack keeps rounding in the triangle inequality from losing
+         * points tied with limit.
+         */
+        static bool beyond(double bound, double limit)
+        {
+            return bound - limit > 1e-9 * (1 + limit);
+        }
+
+        static unsigned sizeClass(Index capacity)
+        {
+            unsigned c = 0;
+            while (capacity >> (c + 1)) ++c;
+            return c;
+        }
+
+        /**
+         * Returns a block of capacity nodes (a power of two), filled with
+         * copies of p.
+         */
+        Index allocBlock(Index capacity, const Point& p)
+        {
+            unsigned c = sizeClass(capacity);
+            if (c < _free.size() && !_free[c].empty()) {
+                Index first = _free[c].back();
+                _free[c].pop_back();
+                return first;
+            }
+            Index first = _nodes.size();
+            _nodes.resize(_nodes.size() + capacity, Node(p, 0, 0));
+            return first;
+        }
+
+        void freeBlock(Index first, Index capacity)
+        {
+            if (capacity == 0) return;
+            unsigned c = sizeClass(capacity);
+            if (_free.size() <= c) _free.resize(c + 1);
+            _free[c].push_back(first);
+        }
+
+        void addChild(Index parent, const Node& child)
+        {
+            if (_nodes[parent].count == _nodes[parent].capacity) {
+                //Move the children to a block twice the size
+                Index capacity = 2;
+                while (capacity <= _nodes[parent].count) capacity *= 2;
+                Index first = allocBlock(capacity, child.point);
+                const Node& par = _nodes[parent];
+                std::copy(_nodes.begin() + par.first,
+                          _nodes.begin() + par.first + par.count,
+                          _nodes.begin() + first);
+                freeBlock(par.first, par.capacity);
+                _nodes[parent].first = first;
+                _nodes[parent].capacity = capacity;
+            }
+            Node& par = _nodes[parent];
+            _nodes[par.first + par.count++] = child;
+        }
+
+        /**
+         * Returns the node holding p (and sets parent to its parent), or
+         * NONE.
+         */
+        Index find(const Point& p, Index& parent) const
+        {
+            if (_root == NONE) return NONE;
+            //Nodes to look at, with their distance to p and their parent
+            struct Step { Index node; double dist; Index parent; };
+            std::vector<Step> stack;
+            Step root = {_root, p.distance(_nodes[_root].point), NONE};
+            stack.push_back(root);
+            while (!stack.empty()) {
+                Step s = stack.back();
+                stack.pop_back();
+                const Node& node = _nodes[s.node];
+                if (s.dist == 0 && node.point == p) {
+                    parent = s.parent;
+                    return s.node;
+                }
+                if (beyond(s.dist - node.radius, 0)) continue;
+                for (Index c = node.first; c < node.first + node.count; ++c) {
+                    const Node& child = _nodes[c];
+                    if (beyond(std::abs(s.dist - child.parentDist)
+                               - child.radius, 0)) continue;
+                    Step next = {c, p.distance(child.point), s.node};
+                    stack.push_back(next);
+                }
+            }
+            return NONE;
+        }
+
+        /**
+         * Sets the radius of node from its members and groups them into
+         * new child nodes, appended to nodes as the block of node's
+         * children, and returned with their own members in groups.
+         */
+        static void partition(const std::vector<Point>& points,
+                              std::vector<Node>& nodes, Index node,
+                              std::vector<Member>& members,
+                              std::vector<Pending>& groups)
+        {
+            double radius = 0;
+            for (const Member& m : members) radius = std::max(radius, m.dist);
+            nodes[node].radius = radius;
+            nodes[node].first = nodes.size();
+
+            if (radius == 0) {
+                //Copies of the node's point: all leaves
+                for (const Member& m : members)
+                    nodes.push_back(Node(points[m.point], 0, 0));
+                nodes[node].count = nodes[node].capacity = members.size();
+                return;
+            }
+
+            const double cover = radius / 2;
+            std::vector<Member> rest;
+            rest.swap(members);
+            while (!rest.empty()) {
+                //The farthest remaining point starts the next ball
+                std::size_t far = 0;
+                for (std::size_t i = 1; i < rest.size(); ++i)
+                    if (rest[i].dist > rest[far].dist) far = i;
+                const Member center = rest[far];
+                rest[far] = rest.back();
+                rest.pop_back();
+
+                groups.push_back(Pending());
+                Pending& group = groups.back();
+                group.node = nodes.size();
+                nodes.push_back(Node(points[center.point], cover,
+                                     center.dist));
+                std::size_t kept = 0;
+                for (const Member& m : rest) {
+                    double d = points[m.point].distance(points[center.point]);
+                    if (d <= cover) {
+                        Member g = {m.point, d};
+                        group.members.push_back(g);
+                    } else {
+                        rest[kept++] = m;
+                    }
+                }
+                rest.resize(kept);
+            }
+            nodes[node].count = nodes[node].capacity =
+                nodes.size() - nodes[node].first;
+        }
+
+        static void buildBelow(const std::vector<Point>& points,
+                               std::vector<Node>& nodes, Index node,
+                               std::vector<Member>& members)
+        {
+            std::vector<Pending> groups;
+            partition(points, nodes, node, members, groups);
+            for (Pending& g : groups)
+                buildBelow(points, nodes, g.node, g.members);
+        }
+
+        void buildParallel(const std::vector<Point>& points,
+                           std::vector<Member>& members, ThreadPool& pool)
+        {
+            //Split the biggest subtree still to build until there are a
+            //few per thread, or they are all small
+            std::vector<Pending> frontier(1);
+            frontier[0].node = _root;
+            frontier[0].members.swap(members);
+            while (frontier.size() < 4 * pool.size()) {
+                std::size_t big = 0;
+                for (std::size_t i = 1; i < frontier.size(); ++i)
+                    if (frontier[i].members.size() >
+                        frontier[big].members.size()) big = i;
+                if (frontier[big].members.size() < PARALLEL_BUILD) break;
+                std::vector<Pending> groups;
+                partition(points, _nodes, frontier[big].node,
+                          frontier[big].members, groups);
+                frontier.erase(frontier.begin() + big);
+                for (Pending& g : groups) {
+                    frontier.push_back(Pending());
+                    frontier.back().node = g.node;
+                    frontier.back().members.swap(g.members);
+                }
+            }
+
+            //Build each subtree in a node vector of its own, rooted at a
+            //copy of its node, and then splice them all in, in order
+            std::vector<std::vector<Node> > parts(frontier.size());
+            pool.parallelFor(frontier.size(), [&](std::size_t i) {
+                const Node& top = _nodes[frontier[i].node];
+                parts[i].push_back(top);
+                buildBelow(points, parts[i], 0, frontier[i].members);
+            });
+            for (std::size_t i = 0; i < parts.size(); ++i) {
+                //Local node j > 0 becomes node offset + j
+                const Index offset = _nodes.size() - 1;
+                Node& top = _nodes[frontier[i].node];
+                top.radius = parts[i][0].radius;
+                top.first = parts[i][0].first + offset;
+                top.count = top.capacity = parts[i][0].count;
+                for (std::size_t j = 1; j < parts[i].size(); ++j) {
+                    _nodes.push_back(parts[i][j]);
+                    _nodes.back().first += offset;
+                }
+            }
+        }
+
+    public:
+        /**
+         * Hands out the points of a tree in increasing distance from a
+         * query, one at a time, keeping the search frontier in between: a
+         * single queue of points and of subtrees (keyed by the nearest any
+         * of their points can be), so the next point costs a few queue
+         * operations, O(log n) amortized, instead of a new search. A child
+         * first goes in with the bound its parent's distance gives it for
+         * free, and only has its own distance computed if it comes to the
+         * top. Points tied in distance come out in node order.
+         *
+         * Neither the tree nor the query point may change while the
+         * iterator is in use.
+         */
+        class NearestIterator
+        {
+        public:
+            NearestIterator(const EmbedCoverTree& tree, const Point& p)
+                : _tree(&tree), _query(p)
+            {
+                if (tree._root != NONE)
+                    push(p.distance(tree._nodes[tree._root].point),
+                         tree._root);
+            }
+
+            /**
+             * The next nearest point, its distance to the query in d, or
+             * 0 once every point has been handed out.
+             */
+            const Point* next(double& d)
+            {
+                while (!_queue.empty()) {
+                    Entry e = _queue.top();
+                    _queue.pop();
+                    const Node& node = _tree->_nodes[e.node];
+                    if (e.kind == POINT) {
+                        d = e.dist;
+                        return &node.point;
+                    }
+                    if (e.kind == BOUNDED) {
+                        push(_query.distance(node.point), e.node);
+                        continue;
+                    }
+                    _queue.push(Entry(e.dist, e.dist, e.node, POINT));
+                    for (Index c = node.first; c < node.first + node.count;
+                         ++c) {
+                        const Node& child = _tree->_nodes[c];
+                        _queue.push(Entry(
+                            loosen(std::abs(e.dist - child.parentDist)
+                                   - child.radius), 0, c, BOUNDED));
+                    }
+                }
+                return 0;
+            }
+
+        private:
+            //On equal keys points come first, so they are not held back
+            //by subtrees that cannot hold anything nearer
+            enum Kind
+            {
+                POINT,   //the node's own point, at dist
+                NODE,    //the node's subtree, dist being the node's
+                BOUNDED  //the node's subtree, its distance not yet known
+            };
+
+            struct Entry
+            {
+                double key; //no point it stands for is nearer than this
+                double dist;
+                Index node;
+                Kind kind;
+
+                Entry(double k, double d, Index n, Kind t)
+                    : key(k), dist(d), node(n), kind(t) {}
+                bool operator>(const Entry& e) const
+                {
+                    if (key != e.key) return key > e.key;
+                    if (kind != e.kind) return kind > e.kind;
+                    return node > e.node;
+                }
+            };
+
+            const EmbedCoverTree* _tree;
+            Point _query;
+            std::priority_queue<Entry, std::vector<Entry>,
+                                std::greater<Entry> > _queue;
+
+            /**
+             * A lower bound made a little lower, so that rounding in the
+             * triangle inequality cannot let a point out of order.
+             */
+            static double loosen(double bound)
+            {
+                return std::max(0.0, bound - 1e-9 * (1 + std::abs(bound)));
+            }
+
+            void push(double d, Index n)
+            {
+                _queue.push(Entry(loosen(d - _tree->_nodes[n].radius), d, n,
+                                  NODE));
+            }
+        };
+    };
+
+    template<typename Point>
+    const typename EmbedCoverTree<Point>::Index EmbedCoverTree<Point>::NONE;
+    template<typename Point>
+    const std::size_t EmbedCoverTree<Point>::PARALLEL_BUILD;
+} //namespace
+
+#endif // _OPENCOG_EMBED_COVER_TREE_H
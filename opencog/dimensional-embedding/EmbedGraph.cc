@@ -0,0 +1,158 @@
+/*
+ * opencog/dimensional-embedding/EmbedGraph.cc
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <algorithm>
+
+#include <opencog/atoms/atom_types/NameServer.h>
+#include <opencog/atoms/base/Link.h>
+#include <opencog/util/exceptions.h>
+
+#include "EmbedGraph.h"
+
+using namespace opencog;
+
+static bool is_source(const Handle& source, const Handle& link)
+{
+    LinkPtr lptr(LinkCast(link));
+    // On ordered links, only the first position in the outgoing set
+    // is a source of this link. So, if the handle given is equal to
+    // the first position, true is returned.
+    Arity arity = lptr->get_arity();
+    if (nameserver().isA(lptr->get_type(), ORDERED_LINK)) {
+        return arity > 0 and lptr->getOutgoingAtom(0) == source;
+    } else if (nameserver().isA(lptr->get_type(), UNORDERED_LINK)) {
+        // If the link is unordered, the outgoing set is scanned;
+        // return true if any position is equal to the source.
+        for (const Handle& h : lptr->getOutgoingSet())
+            if (h == source) return true;
+        return false;
+    }
+    return false;
+}
+
+namespace {
+    // Visits every (u, v, weight) edge of the linkType subgraph. It is run
+    // twice, once to count the out-degrees and once to fill the arrays.
+    template<class Emit>
+    void for_each_edge(const HandleSeq& links,
+                       const std::unordered_map<Handle, uint32_t>& index,
+                       bool symmetric, Emit& emit)
+    {
+        typedef std::unordered_map<Handle, uint32_t>::const_iterator Iter;
+        for (const Handle& link : links) {
+            const HandleSeq& out = link->getOutgoingSet();
+            if (out.empty()) continue;
+            TruthValuePtr linkTV = link->getTruthValue();
+            double weight = linkTV->get_mean() * linkTV->get_confidence();
+            for (size_t i=0; i<out.size(); ++i) {
+                Iter u = index.find(out[i]);
+                if (u==index.end()) continue;
+                //A node that appears twice in the outgoing set still only
+                //has the link once in its incoming set.
+                if (std::find(out.begin(), out.begin()+i, out[i])
+                    != out.begin()+i) continue;
+                if (!symmetric && !is_source(out[i], link)) {
+                    //Reverse edge: from a target back to the source
+                    Iter v = index.find(out[0]);
+                    if (v!=index.end()) emit(true, u->second, v->second, weight);
+                    continue;
+                }
+                for (const Handle& target : out) {
+                    Iter v = index.find(target);
+                    if (v!=index.end()) emit(false, u->second, v->second, weight);
+                }
+            }
+        }
+    }
+
+    struct DegreeCounter
+    {
+        CSRAdjacency& forward;
+        CSRAdjacency& reverse;
+        void operator()(bool rev, uint32_t u, uint32_t, double)
+        {
+            (rev ? reverse : forward).offsets[u+1]++;
+        }
+    };
+
+    struct EdgeFiller
+    {
+        CSRAdjacency& forward;
+        CSRAdjacency& reverse;
+        std::vector<size_t> forwardNext;
+        std::vector<size_t> reverseNext;
+        void operator()(bool rev, uint32_t u, uint32_t v, double weight)
+        {
+            CSRAdjacency& adj = rev ? reverse : forward;
+            size_t& pos = (rev ? reverseNext : forwardNext)[u];
+            adj.targets[pos] = v;
+            adj.weights[pos] = weight;
+            ++pos;
+        }
+    };
+
+    void prefix_sum(CSRAdjacency& adj)
+    {
+        for (size_t i=1; i<adj.offsets.size(); ++i)
+            adj.offsets[i] += adj.offsets[i-1];
+        adj.targets.resize(adj.offsets.back());
+        adj.weights.resize(adj.offsets.back());
+    }
+}
+
+EmbedGraph::EmbedGraph(AtomSpace& as, Type linkType)
+    : _linkType(linkType)
+{
+    if (!nameserver().isLink(linkType))
+        throw InvalidParamException(TRACE_INFO,
+            "DimensionalEmbedding requires link type, not %s",
+            nameserver().getTypeName(linkType).c_str());
+    _symmetric = nameserver().isA(linkType, UNORDERED_LINK);
+
+    as.get_handles_by_type(std::back_inserter(_nodes), NODE, true);
+    _index.reserve(_nodes.size());
+    for (size_t i=0; i<_nodes.size(); ++i) _index[_nodes[i]] = i;
+
+    HandleSeq links;
+    as.get_handles_by_type(std::back_inserter(links), linkType, true);
+
+    _forward.offsets.assign(_nodes.size()+1, 0);
+    _reverse.offsets.assign(_nodes.size()+1, 0);
+    DegreeCounter counter = {_forward, _reverse};
+    for_each_edge(links, _index, _symmetric, counter);
+    prefix_sum(_forward);
+    prefix_sum(_reverse);
+
+    EdgeFiller filler = {_forward, _reverse,
+                         std::vector<size_t>(_forward.offsets.begin(),
+                                             _forward.offsets.end()-1),
+                         std::vector<size_t>(_reverse.offsets.begin(),
+                                             _reverse.offsets.end()-1)};
+    for_each_edge(links, _index, _symmetric, filler);
+}
+
+bool EmbedGraph::getIndex(const Handle& h, size_t& index) const
+{
+    std::unordered_map<Handle, uint32_t>::const_iterator it = _index.find(h);
+    if (it==_index.end()) return false;
+    index = it->second;
+    return true;
+}
@@ -0,0 +1,102 @@
+/*
+ * opencog/dimensional-embedding/EmbedGraph.h
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_EMBED_GRAPH_H
+#define _OPENCOG_EMBED_GRAPH_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include <opencog/atomspace/AtomSpace.h>
+
+namespace opencog
+{
+    /**
+     * Compressed-sparse-row adjacency: the links leaving node u are
+     * targets[offsets[u]] .. targets[offsets[u+1]-1], with the matching
+     * weights in the same positions of weights.
+     */
+    struct CSRAdjacency
+    {
+        std::vector<size_t> offsets;
+        std::vector<uint32_t> targets;
+        std::vector<double> weights;
+
+        size_t numEdges() const { return targets.size(); }
+    };
+
+    /**
+     * A read-only snapshot of the part of the AtomSpace that an embedding
+     * of one link type walks over: every node gets a dense index, and the
+     * links of the type (and its subtypes) are flattened into CSR arrays
+     * with their weights (tv mean*confidence) already computed.
+     *
+     * For symmetric (unordered) link types there is a single adjacency.
+     * For asymmetric ones there is a forward adjacency, following links
+     * from their source to the rest of their outgoing set, and a reverse
+     * adjacency, following links from any other member back to the
+     * source (see the fanin argument of DimEmbedModule::addPivot).
+     *
+     * The snapshot does not track later changes to the AtomSpace.
+     */
+    class EmbedGraph
+    {
+    public:
+        EmbedGraph(AtomSpace& as, Type linkType);
+
+        Type getLinkType() const { return _linkType; }
+        bool isSymmetric() const { return _symmetric; }
+
+        size_t numNodes() const { return _nodes.size(); }
+        const HandleSeq& getNodes() const { return _nodes; }
+        const Handle& getNode(size_t i) const { return _nodes[i]; }
+
+        /**
+         * Looks up the dense index of node h.
+         *
+         * @return false if h was not a node of the AtomSpace when the
+         * snapshot was taken.
+         */
+        bool getIndex(const Handle& h, size_t& index) const;
+
+        /**
+         * The adjacency to search for the given embedding direction. Both
+         * directions share one adjacency for symmetric link types.
+         */
+        const CSRAdjacency& getAdjacency(bool fanin=false) const
+        {
+            return (fanin && !_symmetric) ? _reverse : _forward;
+        }
+
+    private:
+        Type _linkType;
+        bool _symmetric;
+        HandleSeq _nodes;
+        std::unordered_map<Handle, uint32_t> _index;
+        CSRAdjacency _forward;
+        CSRAdjacency _reverse;
+    };
+} //namespace
+
+#endif // _OPENCOG_EMBED_GRAPH_H
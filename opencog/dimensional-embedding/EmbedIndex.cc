@@ -0,0 +1,190 @@
+/*
+ * opencog/dimensional-embedding/EmbedIndex.cc
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+#include <opencog/util/exceptions.h>
+
+#include "EmbedIndex.h"
+#include "FlatIndex.h"
+#include "HnswIndex.h"
+#include "IvfIndex.h"
+
+using namespace opencog;
+
+NeighborCursor::NeighborCursor(const EmbedIndex& index)
+    : _index(&index), _version(index.version())
+{
+}
+
+bool NeighborCursor::isStale() const
+{
+    return _index->version() != _version;
+}
+
+namespace
+{
+    //Pages through an index with kNearest, doubling the page each time,
+    //and skips the rows earlier pages had
+    class PagingCursor : public NeighborCursor
+    {
+    public:
+        PagingCursor(const EmbedIndex& index, const CoverTreePoint& q)
+            : NeighborCursor(index), _query(q), _fetched(0), _at(0) {}
+
+        bool next(EmbeddingStore::Row& r, double& d)
+        {
+            OC_ASSERT(!isStale(), "The index changed under its cursor");
+            if (_at == _page.size()) {
+                //A short page held every row there is
+                if (_fetched > _index->size() || !fetch()) return false;
+            }
+            r = _page[_at].second;
+            d = _page[_at].first;
+            ++_at;
+            return true;
+        }
+
+    private:
+        CoverTreePoint _query;
+        std::size_t _fetched;
+        std::vector<std::pair<double, EmbeddingStore::Row> > _page;
+        std::size_t _at;
+        RowSet _seen;
+
+        bool fetch()
+        {
+            _page.clear();
+            _at = 0;
+            while (_page.empty() && _fetched <= _index->size()) {
+                _fetched = std::max((std::size_t) 16, 2 * _fetched);
+                for (EmbeddingStore::Row r : _index->kNearest(_query,
+                                                              _fetched)) {
+                    if (_seen.contains(r)) continue;
+                    _seen.insert(r);
+                    _page.push_back(std::make_pair(
+                        _query.distance(CoverTreePoint(_index->getStore(), r)),
+                        r));
+                }
+            }
+            std::sort(_page.begin(), _page.end());
+            return !_page.empty();
+        }
+    };
+
+    class CoverTreeCursor : public NeighborCursor
+    {
+    public:
+        CoverTreeCursor(const EmbedIndex& index,
+                        const EmbedCoverTree<CoverTreePoint>::NearestIterator& it)
+            : NeighborCursor(index), _it(it) {}
+
+        bool next(EmbeddingStore::Row& r, double& d)
+        {
+            OC_ASSERT(!isStale(), "The index changed under its cursor");
+            const CoverTreePoint* p = _it.next(d);
+            if (!p) return false;
+            r = p->getRow();
+            return true;
+        }
+
+    private:
+        EmbedCoverTree<CoverTreePoint>::NearestIterator _it;
+    };
+}
+
+NeighborCursorPtr EmbedIndex::neighbors(const CoverTreePoint& q) const
+{
+    return NeighborCursorPtr(new PagingCursor(*this, q));
+}
+
+std::vector<std::vector<EmbedIndex::Row> >
+EmbedIndex::kNearestBatch(const std::vector<CoverTreePoint>& queries,
+                          unsigned k, ThreadPool* pool) const
+{
+    std::vector<std::vector<Row> > results(queries.size());
+    std::function<void(std::size_t)> search = [&](std::size_t i) {
+        results[i] = kNearest(queries[i], k);
+    };
+    if (pool) pool->parallelFor(queries.size(), search);
+    else for (std::size_t i = 0; i < queries.size(); ++i) search(i);
+    return results;
+}
+
+void CoverTreeIndex::build(ThreadPool* pool)
+{
+    std::vector<CoverTreePoint> points;
+    points.reserve(_store->size());
+    for (Row r = 0; r < _store->numRows(); ++r)
+        if (_store->isLive(r)) points.push_back(CoverTreePoint(*_store, r));
+    _tree.build(points, pool);
+    ++_version;
+}
+
+std::vector<EmbedIndex::Row> CoverTreeIndex::kNearest(const CoverTreePoint& q,
+                                                      unsigned k) const
+{
+    return kNearest(q, k, RowFilter());
+}
+
+std::vector<EmbedIndex::Row> CoverTreeIndex::kNearest(
+    const CoverTreePoint& q, unsigned k, const RowFilter& accept) const
+{
+    std::vector<CoverTreePoint> points = accept
+        ? _tree.k_nearest_neighbors(q, k,
+              [&](const CoverTreePoint& p) { return accept(p.getRow()); })
+        : _tree.k_nearest_neighbors(q, k);
+    std::vector<Row> rows;
+    rows.reserve(points.size());
+    for (const CoverTreePoint& p : points) rows.push_back(p.getRow());
+    return rows;
+}
+
+bool CoverTreeIndex::withinRadius(const CoverTreePoint& q, double r,
+                                  const RadiusVisitor& visit) const
+{
+    return _tree.within_radius(q, r,
+        [&](const CoverTreePoint& p, double d) {
+            return visit(p.getRow(), d);
+        });
+}
+
+NeighborCursorPtr CoverTreeIndex::neighbors(const CoverTreePoint& q) const
+{
+    return NeighborCursorPtr(new CoverTreeCursor(*this, _tree.nearest(q)));
+}
+
+EmbedIndexPtr opencog::make_embed_index(const EmbeddingStore& store,
+                                        const EmbedIndexParams& params,
+                                        double maxDist)
+{
+    if (params.type == HNSW_INDEX)
+        return EmbedIndexPtr(new HnswIndex(store, params.M,
+                                           params.efConstruction,
+                                           params.efSearch));
+    if (params.type == FLAT_INDEX)
+        return EmbedIndexPtr(new FlatIndex(store));
+    if (params.type == IVF_INDEX)
+        return EmbedIndexPtr(new IvfIndex(store, params.nprobe));
+    return EmbedIndexPtr(new CoverTreeIndex(store, maxDist));
+}
@@ -0,0 +1,287 @@
+/*
+ * opencog/dimensional-embedding/EmbedIndex.h
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_EMBED_INDEX_H
+#define _OPENCOG_EMBED_INDEX_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "CoverTreePoint.h"
+#include "EmbedCoverTree.h"
+#include "EmbeddingStore.h"
+#include "ThreadPool.h"
+
+namespace opencog
+{
+    /**
+     * The kinds of nearest neighbour index an embedding can be searched
+     * with.
+     */
+    enum EmbedIndexType
+    {
+        COVER_TREE_INDEX, //exact (EmbedCoverTree)
+        HNSW_INDEX,       //approximate (HnswIndex)
+        IVF_INDEX,        //approximate (IvfIndex)
+        FLAT_INDEX        //exact, by brute force (FlatIndex)
+    };
+
+    /**
+     * Which index to keep for an embedding, and its settings.
+     */
+    struct EmbedIndexParams
+    {
+        EmbedIndexType type;
+
+        /**
+         * HNSW: links kept per node on the upper layers (twice as many on
+         * the bottom one). More links give better recall, at the cost of
+         * memory and slower inserts.
+         */
+        unsigned M;
+
+        /**
+         * HNSW: how many candidates an insert looks at to pick the links of
+         * the new node.
+         */
+        unsigned efConstruction;
+
+        /**
+         * HNSW: how many candidates a query keeps (at least k). The main
+         * knob for recall against latency.
+         */
+        unsigned efSearch;
+
+        /**
+         * IVF: number of coarse cells (k-means clusters). 0 picks about
+         * the square root of the number of points.
+         */
+        unsigned numCells;
+
+        /**
+         * IVF: how many of the cells nearest to a query are scanned. The
+         * knob for recall against latency.
+         */
+        unsigned nprobe;
+
+        EmbedIndexParams()
+            : type(COVER_TREE_INDEX), M(16), efConstruction(100),
+              efSearch(64), numCells(0), nprobe(8) {}
+    };
+
+    class EmbedIndex;
+
+    /**
+     * The rows of an index in increasing distance from a query, handed out
+     * on demand (see EmbedIndex::neighbors). A cursor goes stale as soon as
+     * its index changes, and must not be used after that.
+     */
+    class NeighborCursor
+    {
+    public:
+        virtual ~NeighborCursor() {}
+
+        /**
+         * Sets r to the next nearest row, and d to its distance to the
+         * query.
+         *
+         * @return false once every row has been handed out.
+         */
+        virtual bool next(EmbeddingStore::Row& r, double& d) = 0;
+
+        bool isStale() const;
+
+    protected:
+        explicit NeighborCursor(const EmbedIndex& index);
+
+        const EmbedIndex* _index;
+
+    private:
+        std::size_t _version;
+    };
+
+    typedef std::unique_ptr<NeighborCursor> NeighborCursorPtr;
+
+    /**
+     * A nearest neighbour index over the live rows of an EmbeddingStore.
+     * The index only holds row numbers: as with the cover tree points, a
+     * row must not change while it is in the index (remove it, update it,
+     * insert it again).
+     *
+     * Queries are const and may run concurrently; inserts and removes may
+     * not run alongside anything else.
+     */
+    class EmbedIndex
+    {
+    public:
+        typedef EmbeddingStore::Row Row;
+        /**
+         * Called with each row a radius query finds and its distance to
+         * the query; returns false to end the query there.
+         */
+        typedef std::function<bool(Row, double)> RadiusVisitor;
+        /**
+         * Whether a row may be among the results of a query.
+         */
+        typedef std::function<bool(Row)> RowFilter;
+
+        virtual ~EmbedIndex() {}
+
+        virtual const char* name() const = 0;
+
+        /**
+         * Whether kNearest always gives the true nearest neighbours.
+         */
+        virtual bool isExact() const = 0;
+
+        virtual std::size_t size() const = 0;
+
+        /**
+         * Replaces the contents of the index with every live row of the
+         * store, using pool (if given) to build it.
+         */
+        virtual void build(ThreadPool* pool=0) = 0;
+
+        virtual void insert(Row r) = 0;
+
+        /**
+         * Removes r if it is in the index.
+         */
+        virtual void remove(Row r) = 0;
+
+        /**
+         * The rows nearest to q, nearest first (q's own row included, if q
+         * is a row in the index). Exact indices also return every row tied
+         * with the kth, like cogutil's CoverTree.
+         */
+        virtual std::vector<Row> kNearest(const CoverTreePoint& q,
+                                          unsigned k) const = 0;
+
+        /**
+         * kNearest among the rows accept accepts (every row, if accept is
+         * empty). The filter is applied as the index is searched, so other
+         * rows take no place among the k.
+         */
+        virtual std::vector<Row> kNearest(const CoverTreePoint& q, unsigned k,
+                                          const RowFilter& accept) const = 0;
+
+        /**
+         * kNearest for each of queries, spread over pool (if given). By
+         * default the queries are simply run one by one.
+         */
+        virtual std::vector<std::vector<Row> >
+        kNearestBatch(const std::vector<CoverTreePoint>& queries, unsigned k,
+                      ThreadPool* pool=0) const;
+
+        /**
+         * Calls visit for every row within distance r of q, in no
+         * particular order, as they are found; exact for every kind of
+         * index.
+         *
+         * @return false if visit ended the query.
+         */
+        virtual bool withinRadius(const CoverTreePoint& q, double r,
+                                  const RadiusVisitor& visit) const = 0;
+
+        /**
+         * A cursor over the rows in increasing distance from q, which
+         * resumes its search where the last row left it. By default it
+         * fetches pages of doubling size with kNearest, each of them in
+         * order; for an approximate index a later page may then hold a row
+         * nearer than the last of an earlier one. q's data must outlive
+         * the cursor.
+         */
+        virtual NeighborCursorPtr neighbors(const CoverTreePoint& q) const;
+
+        /**
+         * Changes whenever the contents of the index do.
+         */
+        std::size_t version() const { return _version; }
+
+        const EmbeddingStore& getStore() const { return *_store; }
+
+    protected:
+        explicit EmbedIndex(const EmbeddingStore& store)
+            : _store(&store), _version(0) {}
+
+        const EmbeddingStore* _store;
+        //Bumped by every build, insert and remove
+        std::size_t _version;
+    };
+
+    typedef std::shared_ptr<EmbedIndex> EmbedIndexPtr;
+
+    /**
+     * The exact index: an EmbedCoverTree of the store's rows.
+     */
+    class CoverTreeIndex : public EmbedIndex
+    {
+    public:
+        /**
+         * @param maxDist See EmbedCoverTree.
+         */
+        CoverTreeIndex(const EmbeddingStore& store, double maxDist)
+            : EmbedIndex(store), _tree(maxDist) {}
+
+        const char* name() const { return "cover tree"; }
+        bool isExact() const { return true; }
+        std::size_t size() const { return _tree.size(); }
+
+        void build(ThreadPool* pool=0);
+        void insert(Row r)
+        {
+            ++_version;
+            _tree.insert(CoverTreePoint(*_store, r));
+        }
+        void remove(Row r)
+        {
+            ++_version;
+            _tree.remove(CoverTreePoint(*_store, r));
+        }
+        std::vector<Row> kNearest(const CoverTreePoint& q, unsigned k) const;
+        std::vector<Row> kNearest(const CoverTreePoint& q, unsigned k,
+                                  const RowFilter& accept) const;
+        bool withinRadius(const CoverTreePoint& q, double r,
+                          const RadiusVisitor& visit) const;
+
+        /**
+         * Walks the tree incrementally (EmbedCoverTree::NearestIterator),
+         * so every row comes out in exact order.
+         */
+        NeighborCursorPtr neighbors(const CoverTreePoint& q) const;
+
+    private:
+        EmbedCoverTree<CoverTreePoint> _tree;
+    };
+
+    /**
+     * Makes an empty index of the kind params asks for over store. The
+     * points of store lie within maxDist of each other.
+     */
+    EmbedIndexPtr make_embed_index(const EmbeddingStore& store,
+                                   const EmbedIndexParams& params,
+                                   double maxDist);
+} //namespace
+
+#endif // _OPENCOG_EMBED_INDEX_H
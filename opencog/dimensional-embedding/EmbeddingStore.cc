@@ -0,0 +1,219 @@
+/*
+ * opencog/dimensional-embedding/EmbeddingStore.cc
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include <opencog/atoms/base/Atom.h>
+
+#include "DistanceKernels.h"
+#include "EmbeddingStore.h"
+
+using namespace opencog;
+
+const EmbeddingStore::Row EmbeddingStore::npos =
+    std::numeric_limits<EmbeddingStore::Row>::max();
+const uint32_t EmbeddingStore::EMPTY_SLOT;
+const std::size_t EmbeddingStore::COORDINATE_BLOCK;
+
+std::vector<double> EmbedSpan::toVector() const
+{
+    std::vector<double> v(_size);
+    for (std::size_t i = 0; i < _size; ++i) v[i] = (*this)[i];
+    return v;
+}
+
+static std::size_t element_size(EmbedPrecision precision)
+{
+    switch (precision) {
+    case EMBED_FLOAT32: return sizeof(float);
+    case EMBED_FIXED16: return sizeof(uint16_t);
+    case EMBED_QUANT8: return sizeof(uint8_t);
+    default: return sizeof(double);
+    }
+}
+
+EmbeddingStore::EmbeddingStore(std::size_t dimensions,
+                               EmbedPrecision precision, bool keepExact)
+    : _dims(dimensions),
+      _paddedDims((dimensions + COORDINATE_BLOCK - 1) / COORDINATE_BLOCK
+                  * COORDINATE_BLOCK),
+      _precision(precision),
+      _keepExact(keepExact && precision != EMBED_FLOAT64),
+      _rowBytes(_paddedDims * element_size(precision)),
+      _kernels(&distance_kernels(_paddedDims)), _size(0)
+{
+    if (_precision == EMBED_QUANT8) _steps.assign(_paddedDims, 1.0f / 255);
+    rehash(16);
+}
+
+std::size_t EmbeddingStore::slotOf(const Handle& h) const
+{
+    //Mix the bits, since handle hashes are often aligned pointers
+    uint64_t x = std::hash<Handle>()(h);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x & (_slots.size() - 1);
+}
+
+void EmbeddingStore::insertSlot(Row r)
+{
+    std::size_t i = slotOf(_handles[r]);
+    while (_slots[i] != EMPTY_SLOT) i = (i + 1) & (_slots.size() - 1);
+    _slots[i] = r;
+}
+
+void EmbeddingStore::rehash(std::size_t numSlots)
+{
+    _slots.assign(numSlots, EMPTY_SLOT);
+    for (Row r = 0; r < _handles.size(); ++r)
+        if (isLive(r)) insertSlot(r);
+}
+
+EmbeddingStore::Row EmbeddingStore::find(const Handle& h) const
+{
+    std::size_t i = slotOf(h);
+    while (_slots[i] != EMPTY_SLOT) {
+        if (_handles[_slots[i]] == h) return _slots[i];
+        i = (i + 1) & (_slots.size() - 1);
+    }
+    return npos;
+}
+
+void EmbeddingStore::reserve(std::size_t n)
+{
+    _data.reserve(n * _rowBytes);
+    if (_keepExact) _exact.reserve(n * _dims);
+    _handles.reserve(n);
+}
+
+EmbeddingStore::Row EmbeddingStore::add(const Handle& h)
+{
+    Row r = find(h);
+    if (r != npos) return r;
+    //Keep the table at most half full
+    if (2 * (_size + 1) > _slots.size()) rehash(2 * _slots.size());
+    if (!_freeRows.empty()) {
+        r = _freeRows.back();
+        _freeRows.pop_back();
+        _handles[r] = h;
+        std::fill_n(&_data[r * _rowBytes], _rowBytes, 0);
+        if (_keepExact) std::fill_n(&_exact[r * _dims], _dims, 0.0);
+    } else {
+        r = _handles.size();
+        _handles.push_back(h);
+        _data.resize(_data.size() + _rowBytes, 0);
+        if (_keepExact) _exact.resize(_exact.size() + _dims, 0.0);
+    }
+    insertSlot(r);
+    _typeRows[h->get_type()].insert(r);
+    ++_size;
+    return r;
+}
+
+void EmbeddingStore::remove(const Handle& h)
+{
+    const std::size_t mask = _slots.size() - 1;
+    std::size_t i = slotOf(h);
+    while (_slots[i] != EMPTY_SLOT && _handles[_slots[i]] != h)
+        i = (i + 1) & mask;
+    if (_slots[i] == EMPTY_SLOT) return;
+    Row r = _slots[i];
+
+    //Backward-shift deletion: pull later entries of the probe run into
+    //the hole when their home slot allows it, so lookups never need
+    //deletion markers.
+    std::size_t j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (_slots[j] == EMPTY_SLOT) break;
+        std::size_t home = slotOf(_handles[_slots[j]]);
+        bool movable = (i <= j) ? (home <= i || home > j)
+                                : (home <= i && home > j);
+        if (movable) {
+            _slots[i] = _slots[j];
+            i = j;
+        }
+    }
+    _slots[i] = EMPTY_SLOT;
+
+    _typeRows[h->get_type()].erase(r);
+    _handles[r] = Handle::UNDEFINED;
+    _freeRows.push_back(r);
+    --_size;
+}
+
+void EmbeddingStore::set(Row r, std::size_t d, double value)
+{
+    void* row = &_data[r * _rowBytes];
+    switch (_precision) {
+    case EMBED_FLOAT32:
+        static_cast<float*>(row)[d] = (float) value;
+        break;
+    case EMBED_FIXED16:
+        static_cast<uint16_t*>(row)[d] = (uint16_t)
+            std::lround(std::min(1.0, std::max(0.0, value)) * 65535);
+        break;
+    case EMBED_QUANT8:
+        static_cast<uint8_t*>(row)[d] = (uint8_t)
+            std::lround(std::min(255.0, std::max(0.0, value / _steps[d])));
+        break;
+    default:
+        static_cast<double*>(row)[d] = value;
+    }
+    if (_keepExact) _exact[r * _dims + d] = value;
+}
+
+double EmbeddingStore::squaredDistance(Row a, Row b) const
+{
+    const unsigned char* x = &_data[a * _rowBytes];
+    const unsigned char* y = &_data[b * _rowBytes];
+    //Padding is zero in every row, so it adds nothing to the sum
+    switch (_precision) {
+    case EMBED_FLOAT32:
+        return _kernels->float32(reinterpret_cast<const float*>(x),
+                                 reinterpret_cast<const float*>(y), _paddedDims);
+    case EMBED_FIXED16:
+        return _kernels->fixed16(reinterpret_cast<const uint16_t*>(x),
+                                 reinterpret_cast<const uint16_t*>(y),
+                                 _paddedDims);
+    case EMBED_QUANT8:
+        return _kernels->quant8(x, y, _steps.data(), _paddedDims);
+    default:
+        return _kernels->float64(reinterpret_cast<const double*>(x),
+                                 reinterpret_cast<const double*>(y),
+                                 _paddedDims);
+    }
+}
+
+void EmbeddingStore::setColumn(std::size_t d, const std::vector<double>& values)
+{
+    if (_precision == EMBED_QUANT8) {
+        double top = 0;
+        for (Row r = 0; r < numRows(); ++r)
+            if (isLive(r)) top = std::max(top, values[r]);
+        _steps[d] = top > 0 ? top / 255 : 1.0 / 255;
+    }
+    for (Row r = 0; r < numRows(); ++r)
+        if (isLive(r)) set(r, d, values[r]);
+}
@@ -0,0 +1,332 @@
+/*
+ * opencog/dimensional-embedding/EmbeddingStore.h
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_EMBEDDING_STORE_H
+#define _OPENCOG_EMBEDDING_STORE_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <new>
+#include <stdint.h>
+#include <vector>
+
+#include <opencog/atoms/base/Handle.h>
+
+namespace opencog
+{
+    struct DistanceKernels;
+
+    /**
+     * How the coordinates of an embedding are stored. Every coordinate is
+     * a path weight in [0,1], so the compact forms lose little:
+     * EMBED_FIXED16 is within 1/131070 of the exact value, EMBED_QUANT8
+     * within half a step of 1/255 of its dimension's largest value.
+     */
+    enum EmbedPrecision
+    {
+        EMBED_FLOAT64,  //8 bytes per coordinate, exact
+        EMBED_FLOAT32,  //4 bytes per coordinate
+        EMBED_FIXED16,  //2 bytes: round(x*65535)
+        EMBED_QUANT8    //1 byte: round(x/step), one step per dimension
+    };
+
+    /**
+     * Allocator handing out memory aligned to Align bytes, so that rows of
+     * an EmbeddingStore start on cache-line (and SIMD register) boundaries.
+     */
+    template<typename T, std::size_t Align=64>
+    struct AlignedAllocator
+    {
+        typedef T value_type;
+        template<typename U> struct rebind { typedef AlignedAllocator<U, Align> other; };
+
+        AlignedAllocator() {}
+        template<typename U>
+        AlignedAllocator(const AlignedAllocator<U, Align>&) {}
+
+        T* allocate(std::size_t n)
+        {
+            void* p = 0;
+            std::size_t bytes = n > 0 ? n * sizeof(T) : Align;
+            if (posix_memalign(&p, Align, bytes) != 0)
+                throw std::bad_alloc();
+            return static_cast<T*>(p);
+        }
+        void deallocate(T* p, std::size_t) { std::free(p); }
+
+        template<typename U>
+        bool operator==(const AlignedAllocator<U, Align>&) const { return true; }
+        template<typename U>
+        bool operator!=(const AlignedAllocator<U, Align>&) const { return false; }
+    };
+
+    /**
+     * A non-owning view of one embedding vector, in whatever precision it
+     * is stored in; operator[] decodes a single coordinate. It stays valid
+     * until a row is next added to the store it points into.
+     */
+    class EmbedSpan
+    {
+    public:
+        EmbedSpan()
+            : _data(0), _size(0), _precision(EMBED_FLOAT64), _steps(0) {}
+        EmbedSpan(const double* data, std::size_t size)
+            : _data(data), _size(size), _precision(EMBED_FLOAT64), _steps(0) {}
+        EmbedSpan(const std::vector<double>& v)
+            : _data(v.data()), _size(v.size()), _precision(EMBED_FLOAT64),
+              _steps(0) {}
+        /**
+         * @param steps For EMBED_QUANT8, the value of one step in each
+         * dimension.
+         */
+        EmbedSpan(const void* data, std::size_t size,
+                  EmbedPrecision precision, const float* steps)
+            : _data(data), _size(size), _precision(precision), _steps(steps) {}
+
+        std::size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+        EmbedPrecision getPrecision() const { return _precision; }
+        const void* rawData() const { return _data; }
+        const float* getSteps() const { return _steps; }
+
+        /**
+         * The coordinates as doubles, if that is how they are stored (and
+         * null otherwise).
+         */
+        const double* doubles() const
+        {
+            return _precision == EMBED_FLOAT64
+                ? static_cast<const double*>(_data) : 0;
+        }
+
+        double operator[](std::size_t i) const
+        {
+            switch (_precision) {
+            case EMBED_FLOAT32:
+                return static_cast<const float*>(_data)[i];
+            case EMBED_FIXED16:
+                return static_cast<const uint16_t*>(_data)[i] * (1.0 / 65535);
+            case EMBED_QUANT8:
+                return static_cast<const uint8_t*>(_data)[i] * (double) _steps[i];
+            default:
+                return static_cast<const double*>(_data)[i];
+            }
+        }
+
+        std::vector<double> toVector() const;
+
+    private:
+        const void* _data;
+        std::size_t _size;
+        EmbedPrecision _precision;
+        const float* _steps;
+    };
+
+    /**
+     * A set of rows of an EmbeddingStore, as a bitmap: testing a row is a
+     * shift and a mask, and sets combine a word (64 rows) at a time.
+     */
+    class RowSet
+    {
+    public:
+        bool contains(std::size_t r) const
+        {
+            return r / 64 < _words.size() && (_words[r / 64] >> (r % 64)) & 1;
+        }
+        void insert(std::size_t r)
+        {
+            if (r / 64 >= _words.size()) _words.resize(r / 64 + 1, 0);
+            _words[r / 64] |= uint64_t(1) << (r % 64);
+        }
+        void erase(std::size_t r)
+        {
+            if (r / 64 < _words.size())
+                _words[r / 64] &= ~(uint64_t(1) << (r % 64));
+        }
+        RowSet& operator|=(const RowSet& s)
+        {
+            if (s._words.size() > _words.size())
+                _words.resize(s._words.size(), 0);
+            for (std::size_t i = 0; i < s._words.size(); ++i)
+                _words[i] |= s._words[i];
+            return *this;
+        }
+
+    private:
+        std::vector<uint64_t> _words;
+    };
+
+    /**
+     * The embedding vectors of every node for one link type (and direction),
+     * kept in a single contiguous row-major matrix: row r holds the
+     * coordinates of node getHandle(r), one column per pivot.
+     *
+     * Handles are found through an open-addressing hash table of row
+     * numbers. Removing a node leaves a tombstone (isLive(r) is false) and
+     * puts its row on a free list for the next node added, so row numbers
+     * of other nodes never change.
+     *
+     * Coordinates are stored with the store's EmbedPrecision. A compact
+     * store can also keep an exact copy of every row (see getExactRow),
+     * for re-ranking results found on the compact form.
+     *
+     * Rows are padded with zeros to a whole number of COORDINATE_BLOCKs,
+     * so distance kernels can run over whole vector registers without a
+     * tail. The kernels for the padded length are picked when the store is
+     * created (see squaredDistance).
+     */
+    class EmbeddingStore
+    {
+    public:
+        typedef std::size_t Row;
+        static const Row npos;
+        static const std::size_t COORDINATE_BLOCK = 8;
+
+        explicit EmbeddingStore(std::size_t dimensions=0,
+                                EmbedPrecision precision=EMBED_FLOAT64,
+                                bool keepExact=false);
+
+        std::size_t getDimensions() const { return _dims; }
+        EmbedPrecision getPrecision() const { return _precision; }
+
+        /**
+         * Coordinates per row including the (always zero) padding.
+         */
+        std::size_t getPaddedDimensions() const { return _paddedDims; }
+
+        /**
+         * Bytes of coordinate data per row, padding included, not counting
+         * any exact copy.
+         */
+        std::size_t getRowBytes() const { return _rowBytes; }
+
+        /**
+         * Number of live rows (ie embedded nodes).
+         */
+        std::size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+
+        /**
+         * Number of row slots, live or not. Rows are numbered [0,numRows()).
+         */
+        std::size_t numRows() const { return _handles.size(); }
+        bool isLive(Row r) const { return _handles[r] != Handle::UNDEFINED; }
+        const Handle& getHandle(Row r) const { return _handles[r]; }
+
+        /**
+         * @return h's row, or npos if h is not in the store.
+         */
+        Row find(const Handle& h) const;
+        bool contains(const Handle& h) const { return find(h) != npos; }
+
+        /**
+         * Adds h with an all-zero vector and returns its row. If h is
+         * already in the store its existing row is returned unchanged.
+         */
+        Row add(const Handle& h);
+
+        /**
+         * Removes h (if present) and frees its row for reuse.
+         */
+        void remove(const Handle& h);
+
+        /**
+         * The rows of the nodes of each type in the store. Types whose
+         * nodes have all been removed may remain, with no rows.
+         */
+        const std::map<Type, RowSet>& getTypeRows() const { return _typeRows; }
+
+        /**
+         * Reserves room for n rows so that adding them does not move the
+         * matrix (and invalidate outstanding EmbedSpans).
+         */
+        void reserve(std::size_t n);
+
+        EmbedSpan getRow(Row r) const
+        {
+            return EmbedSpan(&_data[r * _rowBytes], _dims, _precision,
+                             _steps.data());
+        }
+
+        /**
+         * True if getExactRow is available: the store is EMBED_FLOAT64, or
+         * keeps an exact copy of its compact rows.
+         */
+        bool hasExact() const
+        {
+            return _precision == EMBED_FLOAT64 || _keepExact;
+        }
+
+        /**
+         * Row r at full precision; requires hasExact().
+         */
+        EmbedSpan getExactRow(Row r) const
+        {
+            if (_precision == EMBED_FLOAT64) return getRow(r);
+            return EmbedSpan(&_exact[r * _dims], _dims);
+        }
+
+        double get(Row r, std::size_t d) const { return getRow(r)[d]; }
+        void set(Row r, std::size_t d, double value);
+
+        /**
+         * The squared euclidean distance between rows a and b, using the
+         * kernels specialized for this store's row length if there are any
+         * (see get_distance_kernels).
+         */
+        double squaredDistance(Row a, Row b) const;
+        const DistanceKernels& getDistanceKernels() const { return *_kernels; }
+
+        /**
+         * Sets coordinate d of every row r to values[r]. For EMBED_QUANT8
+         * this also fixes the step of dimension d, from the largest value;
+         * later values above it are clamped.
+         */
+        void setColumn(std::size_t d, const std::vector<double>& values);
+
+    private:
+        static const uint32_t EMPTY_SLOT = 0xffffffff;
+
+        std::size_t _dims;
+        std::size_t _paddedDims;
+        EmbedPrecision _precision;
+        bool _keepExact;
+        std::size_t _rowBytes;
+        const DistanceKernels* _kernels;
+        std::size_t _size;
+        std::vector<unsigned char, AlignedAllocator<unsigned char> > _data;
+        std::vector<double, AlignedAllocator<double> > _exact;
+        std::vector<float> _steps; //EMBED_QUANT8 step of each (padded) dimension
+        HandleSeq _handles;
+        std::vector<Row> _freeRows;
+        std::vector<uint32_t> _slots; //hash table of row numbers
+        std::map<Type, RowSet> _typeRows;
+
+        std::size_t slotOf(const Handle& h) const;
+        void insertSlot(Row r);
+        void rehash(std::size_t numSlots);
+    };
+} //namespace
+
+#endif // _OPENCOG_EMBEDDING_STORE_H
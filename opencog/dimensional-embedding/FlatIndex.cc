@@ -0,0 +1,342 @@
+/*
+ * opencog/dimensional-embedding/FlatIndex.cc
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+
+#include <opencog/util/exceptions.h>
+
+#include "FlatIndex.h"
+
+using namespace opencog;
+
+const std::size_t FlatIndex::QUERY_BLOCK;
+const std::size_t FlatIndex::ROW_BLOCK;
+
+FlatIndex::FlatIndex(const EmbeddingStore& store)
+    : EmbedIndex(store), _maxNorm(0),
+      //The compact kernels accumulate in float
+      _tolerance(store.getPrecision() == EMBED_FLOAT64 ? 1e-10 : 1e-4)
+{
+}
+
+void FlatIndex::decode(const EmbedSpan& v, double* out) const
+{
+    if (v.doubles()) {
+        std::copy(v.doubles(), v.doubles() + v.size(), out);
+        return;
+    }
+    for (std::size_t d = 0; d < v.size(); ++d) out[d] = v[d];
+}
+
+void FlatIndex::build(ThreadPool* pool)
+{
+    ++_version;
+    _rows.clear();
+    for (Row r = 0; r < _store->numRows(); ++r)
+        if (_store->isLive(r)) _rows.push_back(r);
+    _pos.assign(_store->numRows(), EmbeddingStore::npos);
+    for (std::size_t i = 0; i < _rows.size(); ++i) _pos[_rows[i]] = i;
+
+    _norms.resize(_rows.size());
+    std::function<void(std::size_t)> norm = [&](std::size_t i) {
+        EmbedSpan v = _store->getRow(_rows[i]);
+        double n = 0;
+        for (std::size_t d = 0; d < v.size(); ++d) n += v[d] * v[d];
+        _norms[i] = n;
+    };
+    if (pool) pool->parallelFor(_rows.size(), norm);
+    else for (std::size_t i = 0; i < _rows.size(); ++i) norm(i);
+    _maxNorm = 0;
+    for (double n : _norms) _maxNorm = std::max(_maxNorm, n);
+}
+
+void FlatIndex::insert(Row r)
+{
+    if (r < _pos.size() && _pos[r] != EmbeddingStore::npos) return;
+    ++_version;
+    if (r >= _pos.size()) _pos.resize(r + 1, EmbeddingStore::npos);
+    EmbedSpan v = _store->getRow(r);
+    double n = 0;
+    for (std::size_t d = 0; d < v.size(); ++d) n += v[d] * v[d];
+    _pos[r] = _rows.size();
+    _rows.push_back(r);
+    _norms.push_back(n);
+    _maxNorm = std::max(_maxNorm, n);
+}
+
+void FlatIndex::remove(Row r)
+{
+    if (r >= _pos.size() || _pos[r] == EmbeddingStore::npos) return;
+    ++_version;
+    //The last row takes the place of the removed one (_maxNorm stays an
+    //upper bound)
+    std::size_t at = _pos[r];
+    _rows[at] = _rows.back();
+    _norms[at] = _norms.back();
+    _pos[_rows[at]] = at;
+    _rows.pop_back();
+    _norms.pop_back();
+    _pos[r] = EmbeddingStore::npos;
+}
+
+std::vector<EmbedIndex::Row> FlatIndex::rank(const CoverTreePoint& q,
+                                             std::vector<Scored>& candidates,
+                                             unsigned k) const
+{
+    if (k > 0 && k < candidates.size()
+        && _store->getDimensions() > DISTANCE_BOUND_BLOCK) {
+        //Once k are scored, the worst of them bounds the rest: those
+        //certainly beyond it are left unscored, at infinity
+        std::priority_queue<double> kBest;
+        for (Scored& s : candidates) {
+            CoverTreePoint p(*_store, s.second);
+            if (kBest.size() == k && q.fartherThan(p, kBest.top())) {
+                s.first = std::numeric_limits<double>::infinity();
+                continue;
+            }
+            s.first = q.distance(p);
+            if (kBest.size() < k) kBest.push(s.first);
+            else if (s.first < kBest.top()) {
+                kBest.pop();
+                kBest.push(s.first);
+            }
+        }
+    } else {
+        for (Scored& s : candidates)
+            s.first = q.distance(CoverTreePoint(*_store, s.second));
+    }
+    std::vector<Row> rows;
+    if (candidates.empty()) return rows;
+    if (candidates.size() > k) {
+        std::nth_element(candidates.begin(), candidates.begin() + k - 1,
+                         candidates.end());
+        double kth = candidates[k - 1].first;
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < candidates.size(); ++i)
+            if (candidates[i].first <= kth) candidates[n++] = candidates[i];
+        candidates.resize(n);
+    }
+    std::sort(candidates.begin(), candidates.end());
+    for (const Scored& s : candidates) rows.push_back(s.second);
+    return rows;
+}
+
+std::vector<EmbedIndex::Row> FlatIndex::kNearest(const CoverTreePoint& q,
+                                                 unsigned k) const
+{
+    return kNearest(q, k, RowFilter());
+}
+
+std::vector<EmbedIndex::Row> FlatIndex::kNearest(const CoverTreePoint& q,
+                                                 unsigned k,
+                                                 const RowFilter& accept) const
+{
+    if (k == 0) return std::vector<Row>();
+    std::vector<Scored> all;
+    all.reserve(_rows.size());
+    for (Row r : _rows)
+        if (!accept || accept(r)) all.push_back(Scored(0, r));
+    return rank(q, all, k);
+}
+
+bool FlatIndex::withinRadius(const CoverTreePoint& q, double r,
+                             const RadiusVisitor& visit) const
+{
+    for (Row row : _rows) {
+        CoverTreePoint p(*_store, row);
+        if (q.fartherThan(p, r)) continue;
+        double d = q.distance(p);
+        if (d <= r && !visit(row, d)) return false;
+    }
+    return true;
+}
+
+//The dot products of four queries (x[m*dims...]) with eight rows (columns
+//t[d*stride...] of a transposed tile), into out[m*8+j]. Each step is an
+//outer product, with no dependency between the 32 sums.
+static inline void dot4x8(const double* x, std::size_t dims, const double* t,
+                          std::size_t stride, double* out)
+{
+    double acc[4][8] = {{0}};
+    for (std::size_t d = 0; d < dims; ++d, t += stride) {
+        for (std::size_t m = 0; m < 4; ++m) {
+            double xm = x[m * dims + d];
+            for (std::size_t j = 0; j < 8; ++j) acc[m][j] += xm * t[j];
+        }
+    }
+    for (std::size_t m = 0; m < 4; ++m)
+        for (std::size_t j = 0; j < 8; ++j) out[m * 8 + j] = acc[m][j];
+}
+
+namespace
+{
+    //The k best candidates of one query so far (a max-heap), and those
+    //beyond them by less than slack, which the error of the expansion
+    //could still put among the k.
+    struct Best
+    {
+        std::vector<std::pair<double, std::size_t> > heap, near;
+        double slack;
+        double limit; //the farthest a candidate may be to be kept
+
+        Best() : slack(0), limit(std::numeric_limits<double>::infinity()) {}
+
+        void offer(double dist, std::size_t r, unsigned k)
+        {
+            if (dist > limit) return;
+            std::pair<double, std::size_t> s(dist, r);
+            if (heap.size() < k) {
+                heap.push_back(s);
+                std::push_heap(heap.begin(), heap.end());
+                if (heap.size() == k) limit = heap.front().first + slack;
+                return;
+            }
+            if (s < heap.front()) {
+                std::pop_heap(heap.begin(), heap.end());
+                std::swap(s, heap.back());
+                std::push_heap(heap.begin(), heap.end());
+                limit = heap.front().first + slack;
+                if (s.first > limit) return;
+            }
+            near.push_back(s);
+            if (near.size() > 2 * k + 64) prune();
+        }
+
+        void prune()
+        {
+            std::size_t n = 0;
+            for (std::size_t i = 0; i < near.size(); ++i)
+                if (near[i].first <= limit) near[n++] = near[i];
+            near.resize(n);
+        }
+    };
+}
+
+void FlatIndex::searchBlock(const std::vector<CoverTreePoint>& queries,
+                            std::size_t begin, std::size_t end, unsigned k,
+                            std::vector<std::vector<Row> >& results) const
+{
+    const std::size_t dims = _store->getDimensions();
+    //Rounded up to whole groups of four; the spare queries are zeros
+    const std::size_t nq = (end - begin + 3) / 4 * 4;
+    std::vector<double> qs(nq * dims, 0.0), qnorms(nq, 0.0);
+    std::vector<Best> best(end - begin);
+    for (std::size_t i = 0; i < end - begin; ++i) {
+        double* x = &qs[i * dims];
+        decode(queries[begin + i].getVector(), x);
+        for (std::size_t d = 0; d < dims; ++d) qnorms[i] += x[d] * x[d];
+        //Each term of the expansion errs by a fraction of the norms
+        best[i].slack = 2 * _tolerance * (qnorms[i] + _maxNorm);
+    }
+
+    //Dimension-major, so eight rows of a dimension are contiguous; rows
+    //past the end of the last tile are zeros
+    std::vector<double> tile(ROW_BLOCK * dims), row(dims);
+    double dots[32];
+    for (std::size_t b = 0; b < _rows.size(); b += ROW_BLOCK) {
+        std::size_t n = std::min(ROW_BLOCK, _rows.size() - b);
+        std::fill(tile.begin(), tile.end(), 0.0);
+        for (std::size_t j = 0; j < n; ++j) {
+            decode(_store->getRow(_rows[b + j]), row.data());
+            for (std::size_t d = 0; d < dims; ++d)
+                tile[d * ROW_BLOCK + j] = row[d];
+        }
+        for (std::size_t i = 0; i < nq; i += 4) {
+            for (std::size_t j = 0; j < n; j += 8) {
+                dot4x8(&qs[i * dims], dims, &tile[j], ROW_BLOCK, dots);
+                for (std::size_t m = 0; m < 4 && i + m < end - begin; ++m)
+                    for (std::size_t c = 0; c < 8 && j + c < n; ++c)
+                        best[i + m].offer(qnorms[i + m] + _norms[b + j + c]
+                                          - 2 * dots[m * 8 + c],
+                                          _rows[b + j + c], k);
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < end - begin; ++i) {
+        best[i].prune();
+        std::vector<Scored> candidates(best[i].heap.begin(),
+                                       best[i].heap.end());
+        candidates.insert(candidates.end(), best[i].near.begin(),
+                          best[i].near.end());
+        results[begin + i] = rank(queries[begin + i], candidates, k);
+    }
+}
+
+std::vector<std::vector<EmbedIndex::Row> >
+FlatIndex::kNearestBatch(const std::vector<CoverTreePoint>& queries,
+                         unsigned k, ThreadPool* pool) const
+{
+    std::vector<std::vector<Row> > results(queries.size());
+    if (k == 0) return results;
+    std::size_t blocks = (queries.size() + QUERY_BLOCK - 1) / QUERY_BLOCK;
+    std::function<void(std::size_t)> search = [&](std::size_t b) {
+        searchBlock(queries, b * QUERY_BLOCK,
+                    std::min(queries.size(), (b + 1) * QUERY_BLOCK), k,
+                    results);
+    };
+    if (pool) pool->parallelFor(blocks, search);
+    else for (std::size_t b = 0; b < blocks; ++b) search(b);
+    return results;
+}
+
+namespace
+{
+    class FlatCursor : public NeighborCursor
+    {
+    public:
+        typedef std::pair<double, EmbeddingStore::Row> Scored;
+
+        //scored is taken over, and made into a heap, nearest on top
+        FlatCursor(const EmbedIndex& index, std::vector<Scored>& scored)
+            : NeighborCursor(index)
+        {
+            _heap.swap(scored);
+            std::make_heap(_heap.begin(), _heap.end(), std::greater<Scored>());
+        }
+
+        bool next(EmbeddingStore::Row& r, double& d)
+        {
+            OC_ASSERT(!isStale(), "The index changed under its cursor");
+            if (_heap.empty()) return false;
+            std::pop_heap(_heap.begin(), _heap.end(), std::greater<Scored>());
+            d = _heap.back().first;
+            r = _heap.back().second;
+            _heap.pop_back();
+            return true;
+        }
+
+    private:
+        std::vector<Scored> _heap;
+    };
+}
+
+NeighborCursorPtr FlatIndex::neighbors(const CoverTreePoint& q) const
+{
+    std::vector<Scored> scored(_rows.size());
+    for (std::size_t i = 0; i < _rows.size(); ++i)
+        scored[i] = Scored(q.distance(CoverTreePoint(*_store, _rows[i])),
+                           _rows[i]);
+    return NeighborCursorPtr(new FlatCursor(*this, scored));
+}
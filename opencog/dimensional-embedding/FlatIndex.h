@@ -0,0 +1,105 @@
+/*
+ * opencog/dimensional-embedding/FlatIndex.h
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_FLAT_INDEX_H
+#define _OPENCOG_FLAT_INDEX_H
+
+#include <utility>
+#include <vector>
+
+#include "EmbedIndex.h"
+
+namespace opencog
+{
+    /**
+     * Exact nearest neighbours by brute force: every query is compared
+     * with every row. A single query scans the rows with the store's
+     * distance kernels. A batch of queries is instead answered in tiles,
+     * a block of queries against a block of decoded rows at a time, with
+     * |a-b|^2 = |a|^2 + |b|^2 - 2a.b; each row of a tile is then read once
+     * per block of queries rather than once per query. The few candidates
+     * left at the end are ranked on the store's own distances, so the
+     * results (ties included) are those of the cover tree.
+     */
+    class FlatIndex : public EmbedIndex
+    {
+    public:
+        explicit FlatIndex(const EmbeddingStore& store);
+
+        const char* name() const { return "flat"; }
+        bool isExact() const { return true; }
+        std::size_t size() const { return _rows.size(); }
+
+        void build(ThreadPool* pool=0);
+        void insert(Row r);
+        void remove(Row r);
+        std::vector<Row> kNearest(const CoverTreePoint& q, unsigned k) const;
+        std::vector<Row> kNearest(const CoverTreePoint& q, unsigned k,
+                                  const RowFilter& accept) const;
+        std::vector<std::vector<Row> >
+        kNearestBatch(const std::vector<CoverTreePoint>& queries, unsigned k,
+                      ThreadPool* pool=0) const;
+        bool withinRadius(const CoverTreePoint& q, double r,
+                          const RadiusVisitor& visit) const;
+
+        /**
+         * Measures every row once, up front, and then hands them out of a
+         * heap, in exact order.
+         */
+        NeighborCursorPtr neighbors(const CoverTreePoint& q) const;
+
+    private:
+        //Queries and rows per tile: a tile of rows (of 50 dimensions)
+        //fits in the L1 cache
+        static const std::size_t QUERY_BLOCK = 16;
+        static const std::size_t ROW_BLOCK = 64;
+
+        typedef std::pair<double, Row> Scored;
+
+        std::vector<Row> _rows;           //the indexed rows, in no order
+        std::vector<double> _norms;       //squared norm of each of _rows
+        std::vector<std::size_t> _pos;    //where each row is in _rows
+        double _maxNorm;
+        //Bound on the error of the expansion, relative to the norms,
+        //against the store's distances
+        double _tolerance;
+
+        void decode(const EmbedSpan& v, double* out) const;
+
+        /**
+         * Answers queries [begin, end) of a batch into results.
+         */
+        void searchBlock(const std::vector<CoverTreePoint>& queries,
+                         std::size_t begin, std::size_t end, unsigned k,
+                         std::vector<std::vector<Row> >& results) const;
+
+        /**
+         * The k of candidates nearest to q by the store's distance, and
+         * any tied with the kth, nearest first.
+         */
+        std::vector<Row> rank(const CoverTreePoint& q,
+                              std::vector<Scored>& candidates,
+                              unsigned k) const;
+    };
+} //namespace
+
+#endif // _OPENCOG_FLAT_INDEX_H
@@ -0,0 +1,361 @@
+/*
+ * opencog/dimensional-embedding/HnswIndex.cc
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+
+#include <opencog/util/exceptions.h>
+
+#include "DistanceKernels.h"
+#include "HnswIndex.h"
+
+using namespace opencog;
+
+const HnswIndex::Id HnswIndex::NONE;
+
+//Levels are drawn from a fixed seed, so a graph only depends on the order
+//of its inserts and removes
+static const unsigned LEVEL_SEED = 5489;
+
+HnswIndex::HnswIndex(const EmbeddingStore& store, unsigned M,
+                     unsigned efConstruction, unsigned efSearch)
+    : EmbedIndex(store), _M(std::max(2u, M)), _maxM0(2 * _M),
+      _efConstruction(std::max(efConstruction, _M)), _efSearch(efSearch),
+      _levelMult(1 / std::log((double) _M)), _entry(NONE), _maxLevel(-1),
+      _size(0), _rng(LEVEL_SEED)
+{
+}
+
+double HnswIndex::distance(const CoverTreePoint& q, Id n) const
+{
+    //Distances are only ever compared, so they are left squared
+    if (q.getStore() == _store)
+        return _store->squaredDistance(q.getRow(), n);
+    return squared_distance(q.getVector(), _store->getRow(n));
+}
+
+void HnswIndex::grow(std::size_t rows)
+{
+    OC_ASSERT(rows < NONE);
+    _levels.resize(rows, -1);
+    _links0.resize(rows * (_maxM0 + 1), 0);
+    _upper.resize(rows);
+}
+
+std::unique_ptr<HnswIndex::Visited> HnswIndex::acquireVisited() const
+{
+    std::unique_ptr<Visited> v;
+    {
+        std::lock_guard<std::mutex> lock(_visitedMutex);
+        if (!_visitedPool.empty()) {
+            v = std::move(_visitedPool.back());
+            _visitedPool.pop_back();
+        }
+    }
+    if (!v) v.reset(new Visited());
+    if (v->marks.size() < _levels.size()) v->marks.resize(_levels.size(), 0);
+    //A new epoch unmarks everything at once
+    if (++v->epoch == 0) {
+        std::fill(v->marks.begin(), v->marks.end(), 0);
+        v->epoch = 1;
+    }
+    return v;
+}
+
+void HnswIndex::releaseVisited(std::unique_ptr<Visited> v) const
+{
+    std::lock_guard<std::mutex> lock(_visitedMutex);
+    _visitedPool.push_back(std::move(v));
+}
+
+HnswIndex::Id HnswIndex::greedy(const CoverTreePoint& q, Id entry,
+                                double& dist, int level) const
+{
+    Id cur = entry;
+    bool moved = true;
+    while (moved) {
+        moved = false;
+        const Id* l = links(cur, level);
+        for (Id i = 1; i <= l[0]; ++i) {
+            if (!inLayer(l[i], level)) continue;
+            double d = distance(q, l[i]);
+            if (d < dist) {
+                dist = d;
+                cur = l[i];
+                moved = true;
+            }
+        }
+    }
+    return cur;
+}
+
+std::vector<HnswIndex::Scored>
+HnswIndex::searchLayer(const CoverTreePoint& q, Id entry, double dist,
+                       unsigned ef, int level, const RowFilter* accept) const
+{
+    std::unique_ptr<Visited> visited = acquireVisited();
+    std::vector<uint32_t>& marks = visited->marks;
+    const uint32_t epoch = visited->epoch;
+
+    //Nodes to expand, nearest first, and the ef best, farthest on top
+    std::priority_queue<Scored, std::vector<Scored>,
+                        std::greater<Scored> > frontier;
+    std::priority_queue<Scored> best;
+    marks[entry] = epoch;
+    frontier.push(Scored(dist, entry));
+    if (!accept || (*accept)(entry)) best.push(Scored(dist, entry));
+    while (!frontier.empty()) {
+        Scored c = frontier.top();
+        if (best.size() >= ef && c.first > best.top().first) break;
+        frontier.pop();
+        const Id* l = links(c.second, level);
+        for (Id i = 1; i <= l[0]; ++i) {
+            Id n = l[i];
+            if (marks[n] == epoch) continue;
+            marks[n] = epoch;
+            if (!inLayer(n, level)) continue;
+            double d = distance(q, n);
+            if (best.size() < ef || d < best.top().first) {
+                //Rejected nodes are still walked through
+                frontier.push(Scored(d, n));
+                if (accept && !(*accept)(n)) continue;
+                best.push(Scored(d, n));
+                if (best.size() > ef) best.pop();
+            }
+        }
+    }
+    releaseVisited(std::move(visited));
+
+    std::vector<Scored> found;
+    found.reserve(best.size());
+    while (!best.empty()) {
+        found.push_back(best.top());
+        best.pop();
+    }
+    return found;
+}
+
+void HnswIndex::selectNeighbors(std::vector<Scored>& candidates,
+                                unsigned m) const
+{
+    std::vector<Scored> kept;
+    for (const Scored& c : candidates) {
+        if (kept.size() >= m) break;
+        bool diverse = true;
+        for (const Scored& k : kept) {
+            if (distance(c.second, k.second) < c.first) {
+                diverse = false;
+                break;
+            }
+        }
+        if (diverse) kept.push_back(c);
+    }
+    candidates.swap(kept);
+}
+
+void HnswIndex::setLinks(Id n, int level, std::vector<Scored>& candidates)
+{
+    std::sort(candidates.begin(), candidates.end());
+    selectNeighbors(candidates, maxLinks(level));
+    Id* l = links(n, level);
+    l[0] = candidates.size();
+    for (std::size_t i = 0; i < candidates.size(); ++i)
+        l[i + 1] = candidates[i].second;
+}
+
+void HnswIndex::insert(Row r)
+{
+    if (r >= _levels.size()) grow(r + 1);
+    if (_levels[r] >= 0) return;
+    ++_version;
+    const Id id = r;
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    const int level = (int) (-std::log(1.0 - unit(_rng)) * _levelMult);
+    links(id, 0)[0] = 0;
+    _upper[id].assign(level * (_M + 1), 0);
+
+    //The node only joins the layers (and so becomes visible to searches)
+    //once it is linked
+    if (_entry == NONE) {
+        _levels[id] = level;
+        _entry = id;
+        _maxLevel = level;
+        ++_size;
+        return;
+    }
+    CoverTreePoint q(*_store, r);
+    Id cur = _entry;
+    double dist = distance(q, cur);
+    for (int l = _maxLevel; l > level; --l) cur = greedy(q, cur, dist, l);
+    for (int l = std::min(level, _maxLevel); l >= 0; --l) {
+        std::vector<Scored> found =
+            searchLayer(q, cur, dist, _efConstruction, l);
+        std::sort(found.begin(), found.end());
+        //The nearest node found is where the next layer down starts
+        cur = found[0].second;
+        dist = found[0].first;
+        selectNeighbors(found, _M);
+        Id* own = links(id, l);
+        own[0] = found.size();
+        for (std::size_t i = 0; i < found.size(); ++i) {
+            Id n = found[i].second;
+            own[i + 1] = n;
+            //Link back, making room by re-selecting n's links if full
+            Id* back = links(n, l);
+            if (back[0] < maxLinks(l)) {
+                back[++back[0]] = id;
+                continue;
+            }
+            std::vector<Scored> candidates(1, Scored(found[i].first, id));
+            for (Id j = 1; j <= back[0]; ++j)
+                if (inLayer(back[j], l))
+                    candidates.push_back(Scored(distance(n, back[j]),
+                                                back[j]));
+            setLinks(n, l, candidates);
+        }
+    }
+    _levels[id] = level;
+    if (level > _maxLevel) {
+        _maxLevel = level;
+        _entry = id;
+    }
+    ++_size;
+}
+
+void HnswIndex::remove(Row r)
+{
+    if (r >= _levels.size() || _levels[r] < 0) return;
+    ++_version;
+    const Id id = r;
+    const int level = _levels[id];
+    _levels[id] = -1;
+    --_size;
+
+    //Each neighbor that linked back loses that link, and picks new ones
+    //among its other links and the removed node's
+    for (int l = 0; l <= level; ++l) {
+        const Id* own = links(id, l);
+        std::vector<Id> neighbors;
+        for (Id i = 1; i <= own[0]; ++i)
+            if (inLayer(own[i], l)) neighbors.push_back(own[i]);
+        for (Id n : neighbors) {
+            const Id* back = links(n, l);
+            if (std::find(back + 1, back + 1 + back[0], id) ==
+                back + 1 + back[0]) continue;
+            std::vector<Id> ids(back + 1, back + 1 + back[0]);
+            ids.insert(ids.end(), neighbors.begin(), neighbors.end());
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+            std::vector<Scored> candidates;
+            for (Id c : ids)
+                if (c != n && inLayer(c, l))
+                    candidates.push_back(Scored(distance(n, c), c));
+            setLinks(n, l, candidates);
+        }
+        links(id, l)[0] = 0;
+    }
+    std::vector<Id>().swap(_upper[id]);
+
+    if (id != _entry) return;
+    //The new entry is any node of the highest layer left
+    _entry = NONE;
+    _maxLevel = -1;
+    for (Id n = 0; n < _levels.size(); ++n) {
+        if (_levels[n] > _maxLevel) {
+            _maxLevel = _levels[n];
+            _entry = n;
+        }
+    }
+}
+
+void HnswIndex::build(ThreadPool*)
+{
+    ++_version;
+    _levels.clear();
+    _links0.clear();
+    _upper.clear();
+    _entry = NONE;
+    _maxLevel = -1;
+    _size = 0;
+    _rng.seed(LEVEL_SEED);
+    grow(_store->numRows());
+    for (Row r = 0; r < _store->numRows(); ++r)
+        if (_store->isLive(r)) insert(r);
+}
+
+std::vector<EmbedIndex::Row> HnswIndex::kNearest(const CoverTreePoint& q,
+                                                 unsigned k) const
+{
+    std::vector<Row> rows = kNearest(q, k, RowFilter());
+    if (rows.size() < std::min<std::size_t>(k, _size))
+        return scanNearest(q, k);
+    return rows;
+}
+
+std::vector<EmbedIndex::Row> HnswIndex::scanNearest(const CoverTreePoint& q,
+                                                    unsigned k) const
+{
+    std::vector<Scored> all;
+    all.reserve(_size);
+    for (Id n = 0; n < _levels.size(); ++n)
+        if (inLayer(n, 0)) all.push_back(Scored(distance(q, n), n));
+    if (all.size() > k) {
+        std::nth_element(all.begin(), all.begin() + k, all.end());
+        all.resize(k);
+    }
+    std::sort(all.begin(), all.end());
+    std::vector<Row> rows;
+    rows.reserve(all.size());
+    for (const Scored& s : all) rows.push_back(s.second);
+    return rows;
+}
+
+std::vector<EmbedIndex::Row> HnswIndex::kNearest(const CoverTreePoint& q,
+                                                 unsigned k,
+                                                 const RowFilter& accept) const
+{
+    std::vector<Row> rows;
+    if (k == 0 || _entry == NONE) return rows;
+    Id cur = _entry;
+    double dist = distance(q, cur);
+    for (int l = _maxLevel; l > 0; --l) cur = greedy(q, cur, dist, l);
+    std::vector<Scored> found =
+        searchLayer(q, cur, dist, std::max(_efSearch, k), 0,
+                    accept ? &accept : 0);
+    std::sort(found.begin(), found.end());
+    if (found.size() > k) found.resize(k);
+    rows.reserve(found.size());
+    for (const Scored& s : found) rows.push_back(s.second);
+    return rows;
+}
+
+bool HnswIndex::withinRadius(const CoverTreePoint& q, double r,
+                             const RadiusVisitor& visit) const
+{
+    for (Id n = 0; n < _levels.size(); ++n) {
+        if (!inLayer(n, 0)) continue;
+        double d = q.distance(CoverTreePoint(*_store, n));
+        if (d <= r && !visit(n, d)) return false;
+    }
+    return true;
+}
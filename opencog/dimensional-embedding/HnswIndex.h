@@ -0,0 +1,188 @@
+/*
+ * opencog/dimensional-embedding/HnswIndex.h
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_HNSW_INDEX_H
+#define _OPENCOG_HNSW_INDEX_H
+
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "EmbedIndex.h"
+
+namespace opencog
+{
+    /**
+     * Approximate nearest neighbours with a hierarchical navigable small
+     * world graph (Malkov & Yashunin). Every row is a node of the bottom
+     * layer, and of each layer above with probability 1/M; a query walks
+     * greedily down from the top layer and then searches the bottom one
+     * keeping the efSearch best candidates. Unlike the cover tree, the
+     * cost of a query does not blow up with the number of dimensions.
+     *
+     * Links are kept in flat arrays indexed by row. Removing a row
+     * reconnects its neighbours to each other; links to it from elsewhere
+     * are skipped by searches until its row is reused.
+     */
+    class HnswIndex : public EmbedIndex
+    {
+    public:
+        HnswIndex(const EmbeddingStore& store, unsigned M=16,
+                  unsigned efConstruction=100, unsigned efSearch=64);
+
+        const char* name() const { return "hnsw"; }
+        bool isExact() const { return false; }
+        std::size_t size() const { return _size; }
+
+        /**
+         * Inserts the live rows one at a time, in row order (the pool is
+         * not used), so the graph only depends on the store.
+         */
+        void build(ThreadPool* pool=0);
+        void insert(Row r);
+        void remove(Row r);
+
+        /**
+         * Exactly min(k, size()) rows, without ties beyond the kth. Once
+         * remove() has cut the graph, the search may reach fewer; the
+         * rows are then found by a scan (see scanNearest).
+         */
+        std::vector<Row> kNearest(const CoverTreePoint& q, unsigned k) const;
+
+        /**
+         * Rejected nodes are walked through like the others; with a
+         * filter that rejects most nodes, a query explores much of the
+         * graph before it finds efSearch accepted ones.
+         */
+        std::vector<Row> kNearest(const CoverTreePoint& q, unsigned k,
+                                  const RowFilter& accept) const;
+
+        /**
+         * The graph bounds no distances, so this checks every node.
+         */
+        bool withinRadius(const CoverTreePoint& q, double r,
+                          const RadiusVisitor& visit) const;
+
+        unsigned getEfSearch() const { return _efSearch; }
+        void setEfSearch(unsigned efSearch) { _efSearch = efSearch; }
+
+    private:
+        typedef uint32_t Id;
+        static const Id NONE = 0xffffffff;
+        //A candidate with its squared distance to the query
+        typedef std::pair<double, Id> Scored;
+
+        //Marks of the nodes a search has seen; pooled, so concurrent
+        //queries need neither a lock per node nor an allocation each
+        struct Visited
+        {
+            std::vector<uint32_t> marks;
+            uint32_t epoch;
+            Visited() : epoch(0) {}
+        };
+
+        unsigned _M, _maxM0, _efConstruction, _efSearch;
+        double _levelMult;
+        std::vector<int> _levels;  //top layer of each row; -1 if absent
+        std::vector<Id> _links0;   //per row: a count, then up to _maxM0 ids
+        std::vector<std::vector<Id> > _upper; //per row, per layer above 0:
+                                              //a count, then up to _M ids
+        Id _entry;
+        int _maxLevel;
+        std::size_t _size;
+        std::mt19937 _rng;
+
+        mutable std::mutex _visitedMutex;
+        mutable std::vector<std::unique_ptr<Visited> > _visitedPool;
+
+        HnswIndex(const HnswIndex&);
+        HnswIndex& operator=(const HnswIndex&);
+
+        Id* links(Id n, int level)
+        {
+            return level == 0 ? &_links0[(std::size_t) n * (_maxM0 + 1)]
+                              : &_upper[n][(level - 1) * (_M + 1)];
+        }
+        const Id* links(Id n, int level) const
+        {
+            return const_cast<HnswIndex*>(this)->links(n, level);
+        }
+        unsigned maxLinks(int level) const { return level ? _M : _maxM0; }
+        bool inLayer(Id n, int level) const
+        {
+            return n < _levels.size() && _levels[n] >= level;
+        }
+
+        double distance(const CoverTreePoint& q, Id n) const;
+        double distance(Id a, Id b) const
+        {
+            return _store->squaredDistance(a, b);
+        }
+
+        std::unique_ptr<Visited> acquireVisited() const;
+        void releaseVisited(std::unique_ptr<Visited> v) const;
+
+        /**
+         * Walks from entry (at distance dist from q) to a local minimum of
+         * the distance to q on level, and returns it.
+         */
+        Id greedy(const CoverTreePoint& q, Id entry, double& dist,
+                  int level) const;
+
+        /**
+         * The ef nodes nearest to q found by a best-first search of level
+         * from entry, in no particular order; only those accept accepts,
+         * if given.
+         */
+        std::vector<Scored> searchLayer(const CoverTreePoint& q, Id entry,
+                                        double dist, unsigned ef, int level,
+                                        const RowFilter* accept=0) const;
+
+        /**
+         * Keeps at most m of candidates (sorted nearest first to their
+         * base node), skipping those nearer to a kept one than to the
+         * base, so the links spread out in different directions.
+         */
+        void selectNeighbors(std::vector<Scored>& candidates,
+                             unsigned m) const;
+
+        /**
+         * Sets the links of n on level to the best maxLinks(level) of
+         * candidates.
+         */
+        void setLinks(Id n, int level, std::vector<Scored>& candidates);
+
+        /**
+         * The k nodes nearest to q, nearest first, found by checking every
+         * node.
+         */
+        std::vector<Row> scanNearest(const CoverTreePoint& q,
+                                     unsigned k) const;
+
+        void grow(std::size_t rows);
+    };
+} //namespace
+
+#endif // _OPENCOG_HNSW_INDEX_H
@@ -0,0 +1,166 @@
+/*
+ * opencog/dimensional-embedding/IndexedHeap.h
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_INDEXED_HEAP_H
+#define _OPENCOG_INDEXED_HEAP_H
+
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace opencog
+{
+    /**
+     * An indexed d-ary heap over the dense ids [0,n).
+     *
+     * Each id is in the heap at most once, and the heap remembers where
+     * every id lives, so the priority of an id already in the heap can be
+     * changed in O(log_D n) without searching for it. Like
+     * std::priority_queue, the element on top is the one that compares
+     * greatest under Compare (so the default is a max-heap).
+     *
+     * Only ids that have been pushed take up room in the heap; the
+     * position table is a flat array of n entries.
+     */
+    template<typename Key, unsigned D=4, typename Compare=std::less<Key> >
+    class IndexedHeap
+    {
+    public:
+        typedef std::size_t Id;
+
+        explicit IndexedHeap(std::size_t n=0, Compare comp=Compare())
+            : _comp(comp) { reset(n); }
+
+        /**
+         * Empties the heap and makes room for the ids [0,n).
+         */
+        void reset(std::size_t n)
+        {
+            _heap.clear();
+            _pos.assign(n, npos);
+        }
+
+        bool empty() const { return _heap.empty(); }
+        std::size_t size() const { return _heap.size(); }
+        bool contains(Id id) const { return _pos[id] != npos; }
+
+        const Key& topKey() const { return _heap.front().first; }
+        Id top() const { return _heap.front().second; }
+
+        /**
+         * Inserts id with the given key. id must not already be in the heap.
+         */
+        void push(Id id, const Key& key)
+        {
+            _pos[id] = _heap.size();
+            _heap.push_back(Entry(key, id));
+            siftUp(_heap.size() - 1);
+        }
+
+        /**
+         * Raises the priority of an id already in the heap (ie key must
+         * not compare less than its current key).
+         */
+        void increase(Id id, const Key& key)
+        {
+            std::size_t i = _pos[id];
+            _heap[i].first = key;
+            siftUp(i);
+        }
+
+        /**
+         * Inserts id, or raises its priority if it is already queued.
+         */
+        void pushOrIncrease(Id id, const Key& key)
+        {
+            if (contains(id)) increase(id, key);
+            else push(id, key);
+        }
+
+        /**
+         * Removes and returns the id with the highest priority.
+         */
+        Id pop()
+        {
+            Id id = _heap.front().second;
+            _pos[id] = npos;
+            Entry last = _heap.back();
+            _heap.pop_back();
+            if (!_heap.empty()) {
+                _heap.front() = last;
+                _pos[last.second] = 0;
+                siftDown(0);
+            }
+            return id;
+        }
+
+    private:
+        typedef std::pair<Key, Id> Entry;
+        static const std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+        std::vector<Entry> _heap;
+        std::vector<std::size_t> _pos; //_pos[id] is id's slot in _heap
+        Compare _comp;
+
+        void siftUp(std::size_t i)
+        {
+            Entry e = _heap[i];
+            while (i > 0) {
+                std::size_t parent = (i - 1) / D;
+                if (!_comp(_heap[parent].first, e.first)) break;
+                _heap[i] = _heap[parent];
+                _pos[_heap[i].second] = i;
+                i = parent;
+            }
+            _heap[i] = e;
+            _pos[e.second] = i;
+        }
+
+        void siftDown(std::size_t i)
+        {
+            Entry e = _heap[i];
+            const std::size_t n = _heap.size();
+            while (true) {
+                std::size_t first = i * D + 1;
+                if (first >= n) break;
+                std::size_t last = first + D < n ? first + D : n;
+                std::size_t best = first;
+                for (std::size_t c = first + 1; c < last; ++c) {
+                    if (_comp(_heap[best].first, _heap[c].first)) best = c;
+                }
+                if (!_comp(e.first, _heap[best].first)) break;
+                _heap[i] = _heap[best];
+                _pos[_heap[i].second] = i;
+                i = best;
+            }
+            _heap[i] = e;
+            _pos[e.second] = i;
+        }
+    };
+
+    template<typename Key, unsigned D, typename Compare>
+    const std::size_t IndexedHeap<Key, D, Compare>::npos;
+} //namespace
+
+#endif // _OPENCOG_INDEXED_HEAP_H
@@ -0,0 +1,338 @@
+/*
+ * opencog/dimensional-embedding/IvfIndex.cc
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+
+#include <opencog/util/exceptions.h>
+
+#include "DistanceKernels.h"
+#include "IvfIndex.h"
+
+using namespace opencog;
+
+const uint32_t IvfIndex::NONE;
+
+IvfIndex::IvfIndex(const EmbeddingStore& store, unsigned nprobe)
+    : EmbedIndex(store), _padded(store.getPaddedDimensions()),
+      _kernels(&distance_kernels(_padded)), _nprobe(std::max(1u, nprobe)),
+      _size(0)
+{
+}
+
+void IvfIndex::decode(const EmbedSpan& v, float* out) const
+{
+    std::fill(out, out + _padded, 0.0f);
+    for (std::size_t d = 0; d < v.size(); ++d) out[d] = (float) v[d];
+}
+
+void IvfIndex::setCentroids(const std::vector<std::vector<double> >& centroids)
+{
+    OC_ASSERT(!centroids.empty());
+    ++_version;
+    _cells.assign(centroids.size(), Cell());
+    for (std::size_t c = 0; c < centroids.size(); ++c) {
+        OC_ASSERT(centroids[c].size() == _store->getDimensions());
+        _cells[c].centroid.resize(_padded);
+        decode(EmbedSpan(centroids[c]), _cells[c].centroid.data());
+    }
+    _where.clear();
+    _size = 0;
+}
+
+uint32_t IvfIndex::nearestCell(const float* x) const
+{
+    uint32_t best = 0;
+    double bestDist = 0;
+    for (uint32_t c = 0; c < _cells.size(); ++c) {
+        double d = _kernels->float32(x, _cells[c].centroid.data(), _padded);
+        if (c == 0 || d < bestDist) {
+            best = c;
+            bestDist = d;
+        }
+    }
+    return best;
+}
+
+void IvfIndex::file(Row r, uint32_t cell, const float* x)
+{
+    Cell& c = _cells[cell];
+    if (r >= _where.size()) _where.resize(r + 1, std::make_pair(NONE, NONE));
+    _where[r] = std::make_pair(cell, (uint32_t) c.rows.size());
+    c.rows.push_back(r);
+    std::size_t at = c.residuals.size();
+    c.residuals.resize(at + _padded);
+    double norm = 0;
+    for (std::size_t d = 0; d < _padded; ++d) {
+        c.residuals[at + d] = x[d] - c.centroid[d];
+        norm += c.residuals[at + d] * c.residuals[at + d];
+    }
+    //Removing points leaves it as an upper bound
+    c.radius = std::max(c.radius, std::sqrt(norm));
+    ++_size;
+}
+
+void IvfIndex::build(ThreadPool* pool)
+{
+    std::vector<Row> live;
+    for (Row r = 0; r < _store->numRows(); ++r)
+        if (_store->isLive(r)) live.push_back(r);
+    ++_version;
+
+    if (_cells.empty()) {
+        std::size_t n = std::max((std::size_t) 1,
+                                 (std::size_t) std::sqrt((double) live.size()));
+        std::vector<std::vector<double> > centroids;
+        for (std::size_t i = 0; i < n && i < live.size(); ++i)
+            centroids.push_back(
+                _store->getRow(live[i * live.size() / n]).toVector());
+        if (centroids.empty()) return;
+        setCentroids(centroids);
+    }
+    for (Cell& c : _cells) {
+        c.residuals.clear();
+        c.rows.clear();
+        c.radius = 0;
+    }
+    _where.assign(_store->numRows(), std::make_pair(NONE, NONE));
+    _size = 0;
+
+    //Finding the cells is the expensive part, and independent per row;
+    //filing them is then a sequential copy
+    std::vector<float> decoded(live.size() * _padded);
+    std::vector<uint32_t> cells(live.size());
+    std::function<void(std::size_t)> assign = [&](std::size_t i) {
+        float* x = &decoded[i * _padded];
+        decode(_store->getRow(live[i]), x);
+        cells[i] = nearestCell(x);
+    };
+    if (pool) pool->parallelFor(live.size(), assign);
+    else for (std::size_t i = 0; i < live.size(); ++i) assign(i);
+
+    std::vector<std::size_t> counts(_cells.size(), 0);
+    for (uint32_t c : cells) ++counts[c];
+    for (std::size_t c = 0; c < _cells.size(); ++c) {
+        _cells[c].rows.reserve(counts[c]);
+        _cells[c].residuals.reserve(counts[c] * _padded);
+    }
+    for (std::size_t i = 0; i < live.size(); ++i)
+        file(live[i], cells[i], &decoded[i * _padded]);
+}
+
+void IvfIndex::insert(Row r)
+{
+    if (r < _where.size() && _where[r].first != NONE) return;
+    ++_version;
+    std::vector<float> x(_padded);
+    decode(_store->getRow(r), x.data());
+    if (_cells.empty()) {
+        //The first point of an index built empty starts its only cell
+        _cells.resize(1);
+        _cells[0].centroid = x;
+    }
+    file(r, nearestCell(x.data()), x.data());
+}
+
+void IvfIndex::remove(Row r)
+{
+    if (r >= _where.size() || _where[r].first == NONE) return;
+    ++_version;
+    Cell& c = _cells[_where[r].first];
+    uint32_t at = _where[r].second;
+    uint32_t last = c.rows.size() - 1;
+    //The last point of the cell takes the place of the removed one
+    if (at != last) {
+        c.rows[at] = c.rows[last];
+        std::copy(c.residuals.begin() + last * _padded,
+                  c.residuals.begin() + (last + 1) * _padded,
+                  c.residuals.begin() + at * _padded);
+        _where[c.rows[at]].second = at;
+    }
+    c.rows.pop_back();
+    c.residuals.resize(last * _padded);
+    _where[r] = std::make_pair(NONE, NONE);
+    --_size;
+}
+
+std::vector<EmbedIndex::Row> IvfIndex::kNearest(const CoverTreePoint& q,
+                                                unsigned k) const
+{
+    return kNearest(q, k, RowFilter());
+}
+
+std::vector<EmbedIndex::Row> IvfIndex::kNearest(const CoverTreePoint& q,
+                                                unsigned k,
+                                                const RowFilter& accept) const
+{
+    std::vector<Row> rows;
+    if (k == 0 || _size == 0) return rows;
+    std::vector<float> x(_padded);
+    decode(q.getVector(), x.data());
+
+    //The nprobe nearest cells that have any points
+    std::vector<std::pair<double, uint32_t> > order;
+    for (uint32_t c = 0; c < _cells.size(); ++c) {
+        if (_cells[c].rows.empty()) continue;
+        order.push_back(std::make_pair(
+            _kernels->float32(x.data(), _cells[c].centroid.data(), _padded),
+            c));
+    }
+    std::size_t probes = std::min((std::size_t) _nprobe, order.size());
+    //A filter may leave the nprobe cells short of k points; then the
+    //next nearest cells are scanned too, until there are k
+    if (accept) std::sort(order.begin(), order.end());
+    else std::partial_sort(order.begin(), order.begin() + probes, order.end());
+
+    //The k best, worst on top
+    std::priority_queue<std::pair<double, Row> > best;
+    std::vector<float> shifted(_padded);
+    for (std::size_t p = 0;
+         p < probes || (best.size() < k && p < order.size()); ++p) {
+        const Cell& c = _cells[order[p].second];
+        //|x - (centroid + residual)| = |(x - centroid) - residual|
+        for (std::size_t d = 0; d < _padded; ++d)
+            shifted[d] = x[d] - c.centroid[d];
+        const float* residual = c.residuals.data();
+        for (std::size_t i = 0; i < c.rows.size(); ++i, residual += _padded) {
+            if (accept && !accept(c.rows[i])) continue;
+            std::pair<double, Row> s(
+                _kernels->float32(shifted.data(), residual, _padded),
+                c.rows[i]);
+            if (best.size() < k) {
+                best.push(s);
+            } else if (s < best.top()) {
+                best.pop();
+                best.push(s);
+            }
+        }
+    }
+    rows.resize(best.size());
+    for (std::size_t i = best.size(); i-- > 0; best.pop())
+        rows[i] = best.top().second;
+    return rows;
+}
+
+bool IvfIndex::withinRadius(const CoverTreePoint& q, double r,
+                            const RadiusVisitor& visit) const
+{
+    if (_size == 0) return true;
+    std::vector<float> x(_padded), shifted(_padded);
+    decode(q.getVector(), x.data());
+    //The float coordinates only rule points out, with some slack for
+    //their rounding; the rest are measured on the store
+    double limit = r + 1e-4 * (1 + r);
+    for (const Cell& c : _cells) {
+        if (c.rows.empty()) continue;
+        double dc = std::sqrt(_kernels->float32(x.data(), c.centroid.data(),
+                                                _padded));
+        if (dc - c.radius > limit) continue;
+        for (std::size_t d = 0; d < _padded; ++d)
+            shifted[d] = x[d] - c.centroid[d];
+        const float* residual = c.residuals.data();
+        for (std::size_t i = 0; i < c.rows.size(); ++i, residual += _padded) {
+            if (_kernels->float32(shifted.data(), residual, _padded)
+                > limit * limit) continue;
+            CoverTreePoint p(*_store, c.rows[i]);
+            if (q.fartherThan(p, r)) continue;
+            double d = q.distance(p);
+            if (d <= r && !visit(c.rows[i], d)) return false;
+        }
+    }
+    return true;
+}
+
+namespace
+{
+    class IvfCursor : public NeighborCursor
+    {
+    public:
+        typedef const std::vector<EmbeddingStore::Row>* CellRows;
+
+        //Each of cells comes with a bound on the distance of its points
+        IvfCursor(const IvfIndex& index, const CoverTreePoint& q,
+                  const std::vector<std::pair<double, CellRows> >& cells)
+            : NeighborCursor(index), _query(q), _cells(cells)
+        {
+            for (std::size_t c = 0; c < cells.size(); ++c)
+                _queue.push(Entry(cells[c].first, true, c));
+        }
+
+        bool next(EmbeddingStore::Row& r, double& d)
+        {
+            OC_ASSERT(!isStale(), "The index changed under its cursor");
+            while (!_queue.empty()) {
+                Entry e = _queue.top();
+                _queue.pop();
+                if (!e.cell) {
+                    r = e.id;
+                    d = e.key;
+                    return true;
+                }
+                for (EmbeddingStore::Row row : *_cells[e.id].second)
+                    _queue.push(Entry(_query.distance(
+                        CoverTreePoint(_index->getStore(), row)), false, row));
+            }
+            return false;
+        }
+
+    private:
+        struct Entry
+        {
+            double key;
+            bool cell; //rows come first on equal keys
+            std::size_t id;
+
+            Entry(double k, bool c, std::size_t i) : key(k), cell(c), id(i) {}
+            bool operator>(const Entry& e) const
+            {
+                if (key != e.key) return key > e.key;
+                if (cell != e.cell) return cell;
+                return id > e.id;
+            }
+        };
+
+        CoverTreePoint _query;
+        std::vector<std::pair<double, CellRows> > _cells;
+        std::priority_queue<Entry, std::vector<Entry>,
+                            std::greater<Entry> > _queue;
+    };
+}
+
+NeighborCursorPtr IvfIndex::neighbors(const CoverTreePoint& q) const
+{
+    std::vector<float> x(_padded);
+    decode(q.getVector(), x.data());
+    std::vector<std::pair<double, IvfCursor::CellRows> > cells;
+    for (std::size_t c = 0; c < _cells.size(); ++c) {
+        if (_cells[c].rows.empty()) continue;
+        //With the same slack for the float coordinates as withinRadius
+        double dc = std::sqrt(_kernels->float32(x.data(),
+                                                _cells[c].centroid.data(),
+                                                _padded));
+        double bound = dc - _cells[c].radius;
+        cells.push_back(std::make_pair(
+            std::max(0.0, bound - 1e-4 * (1 + std::abs(bound))),
+            &_cells[c].rows));
+    }
+    return NeighborCursorPtr(new IvfCursor(*this, q, cells));
+}
@@ -0,0 +1,138 @@
+/*
+ * opencog/dimensional-embedding/IvfIndex.h
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_IVF_INDEX_H
+#define _OPENCOG_IVF_INDEX_H
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "EmbedIndex.h"
+
+namespace opencog
+{
+    struct DistanceKernels;
+
+    /**
+     * Approximate nearest neighbours with an inverted file: the points are
+     * filed under their nearest of a set of centroids (coarse cells), and
+     * a query only scans the nprobe cells whose centroids are nearest to
+     * it. Each cell keeps its points as residuals (point minus centroid,
+     * as padded float32 rows) in one contiguous block, so a query reads
+     * roughly nprobe/numCells of the data, sequentially.
+     *
+     * The centroids are given (DimEmbedModule uses its k-means clusters)
+     * and stay fixed as points come and go; re-clustering means setting
+     * new centroids and building again.
+     */
+    class IvfIndex : public EmbedIndex
+    {
+    public:
+        /**
+         * @param nprobe Cells scanned per query.
+         */
+        IvfIndex(const EmbeddingStore& store, unsigned nprobe=8);
+
+        const char* name() const { return "ivf"; }
+        bool isExact() const { return false; }
+        std::size_t size() const { return _size; }
+
+        /**
+         * Sets the coarse cells, one per centroid (each with the store's
+         * number of dimensions). This empties the index; build() files
+         * the rows again.
+         */
+        void setCentroids(const std::vector<std::vector<double> >& centroids);
+        std::size_t numCells() const { return _cells.size(); }
+
+        /**
+         * Files every live row of the store under its nearest centroid
+         * (finding them in parallel on pool, if given). Without centroids,
+         * about sqrt(size) evenly spread rows serve as centroids.
+         */
+        void build(ThreadPool* pool=0);
+        void insert(Row r);
+        void remove(Row r);
+
+        /**
+         * Exactly min(k, points in the probed cells) rows, without ties
+         * beyond the kth.
+         */
+        std::vector<Row> kNearest(const CoverTreePoint& q, unsigned k) const;
+
+        /**
+         * Scans beyond the nprobe nearest cells if they hold fewer than k
+         * accepted points.
+         */
+        std::vector<Row> kNearest(const CoverTreePoint& q, unsigned k,
+                                  const RowFilter& accept) const;
+
+        /**
+         * Skips the cells lying wholly beyond r, by the distance from
+         * their centroid to their farthest point.
+         */
+        bool withinRadius(const CoverTreePoint& q, double r,
+                          const RadiusVisitor& visit) const;
+
+        /**
+         * Opens the cells in order of the nearest their points can be (as
+         * withinRadius bounds them), so every row comes out in exact
+         * order, having only read the cells up to the farthest one asked
+         * for.
+         */
+        NeighborCursorPtr neighbors(const CoverTreePoint& q) const;
+
+        unsigned getNprobe() const { return _nprobe; }
+        void setNprobe(unsigned nprobe) { _nprobe = nprobe; }
+
+    private:
+        static const uint32_t NONE = 0xffffffff;
+
+        struct Cell
+        {
+            std::vector<float> centroid;  //padded
+            std::vector<float> residuals; //one padded row per point
+            std::vector<Row> rows;        //the store row of each point
+            double radius; //no point is farther from the centroid
+
+            Cell() : radius(0) {}
+        };
+
+        std::size_t _padded;
+        const DistanceKernels* _kernels;
+        unsigned _nprobe;
+        std::vector<Cell> _cells;
+        //Cell and position in it of each row (NONE if not in the index)
+        std::vector<std::pair<uint32_t, uint32_t> > _where;
+        std::size_t _size;
+
+        /**
+         * Writes the coordinates of v to out, as a padded float row.
+         */
+        void decode(const EmbedSpan& v, float* out) const;
+        uint32_t nearestCell(const float* x) const;
+        void file(Row r, uint32_t cell, const float* x);
+    };
+} //namespace
+
+#endif // _OPENCOG_IVF_INDEX_H
@@ -0,0 +1,440 @@
+/*
+ * opencog/dimensional-embedding/KMeans.cc
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <unordered_set>
+
+#include <opencog/util/exceptions.h>
+
+#include "DistanceKernels.h"
+#include "KMeans.h"
+#include "ThreadPool.h"
+
+using namespace opencog;
+
+const std::size_t KMeans::BLOCK;
+
+KMeans::KMeans(ThreadPool* pool, unsigned seed)
+    : _pool(pool), _seed(seed), _maxIterations(300), _batchSize(0),
+      _tolerance(0), _kernels(&distance_kernels()), _points(0), _dims(0), _k(0),
+      _bestError(0), _bestIterations(0), _distanceCount(0)
+{
+}
+
+double KMeans::distance2(const EmbedSpan& p, const double* c) const
+{
+    if (p.doubles()) return _kernels->float64(p.doubles(), c, _dims);
+    return squared_distance(p, EmbedSpan(c, _dims));
+}
+
+void KMeans::forBlocks(std::size_t n,
+                       const std::function<void(std::size_t, std::size_t,
+                                                std::size_t)>& fn)
+{
+    std::size_t blocks = (n + BLOCK - 1) / BLOCK;
+    std::function<void(std::size_t)> block = [&](std::size_t b) {
+        fn(b * BLOCK, std::min(n, (b + 1) * BLOCK), b);
+    };
+    if (_pool && blocks > 1) _pool->parallelFor(blocks, block);
+    else for (std::size_t b = 0; b < blocks; ++b) block(b);
+}
+
+void KMeans::seed(unsigned seed)
+{
+    //k-means++: each next centroid is a point drawn with probability
+    //proportional to its squared distance to the nearest one so far
+    const std::vector<EmbedSpan>& points = *_points;
+    std::size_t n = _sample.empty() ? points.size() : _sample.size();
+    std::function<const EmbedSpan&(std::size_t)> point =
+        [&](std::size_t i) -> const EmbedSpan& {
+            return points[_sample.empty() ? i : _sample[i]];
+        };
+    std::mt19937 rng(seed);
+    std::vector<double> nearest(n);
+    std::size_t pick = std::uniform_int_distribution<std::size_t>(0, n - 1)(rng);
+    for (int c = 0; c < _k; ++c) {
+        double* center = &_centers[c * _dims];
+        for (std::size_t d = 0; d < _dims; ++d) center[d] = point(pick)[d];
+        if (c + 1 == _k) break;
+
+        forBlocks(n, [&](std::size_t begin, std::size_t end, std::size_t) {
+            for (std::size_t i = begin; i < end; ++i) {
+                double d = distance2(point(i), center);
+                if (c == 0 || d < nearest[i]) nearest[i] = d;
+            }
+        });
+        _distanceCount += n;
+
+        double total = 0;
+        for (double d : nearest) total += d;
+        if (total > 0) {
+            double r = std::uniform_real_distribution<double>(0, total)(rng);
+            pick = n - 1;
+            for (std::size_t i = 0; i < n; ++i) {
+                if (r < nearest[i]) {
+                    pick = i;
+                    break;
+                }
+                r -= nearest[i];
+            }
+            //Rounding may leave the walk on a point that is a centroid
+            while (nearest[pick] == 0) pick = (pick + n - 1) % n;
+        } else {
+            //Fewer distinct points than clusters
+            pick = std::uniform_int_distribution<std::size_t>(0, n - 1)(rng);
+        }
+    }
+}
+
+int KMeans::nearest(const EmbedSpan& p, double& distance) const
+{
+    int id = 0;
+    distance = std::numeric_limits<double>::infinity();
+    for (int c = 0; c < _k; ++c) {
+        double d = distance2(p, &_centers[c * _dims]);
+        if (d < distance) {
+            distance = d;
+            id = c;
+        }
+    }
+    return id;
+}
+
+std::size_t KMeans::assignAll(std::size_t begin, std::size_t end)
+{
+    const std::vector<EmbedSpan>& points = *_points;
+    for (std::size_t i = begin; i < end; ++i) {
+        double best = std::numeric_limits<double>::infinity();
+        double second = best;
+        int id = 0;
+        for (int c = 0; c < _k; ++c) {
+            double d = distance2(points[i], &_centers[c * _dims]);
+            if (d < best) {
+                second = best;
+                best = d;
+                id = c;
+            } else if (d < second) {
+                second = d;
+            }
+        }
+        _ids[i] = id;
+        _upper[i] = std::sqrt(best);
+        _lower[i] = std::sqrt(second);
+    }
+    return (end - begin) * _k;
+}
+
+std::size_t KMeans::assign(std::size_t begin, std::size_t end,
+                           std::size_t& distances)
+{
+    const std::vector<EmbedSpan>& points = *_points;
+    std::size_t changed = 0;
+    for (std::size_t i = begin; i < end; ++i) {
+        int id = _ids[i];
+        double bound = std::max(_half[id], _lower[i]);
+        if (_upper[i] <= bound) continue;
+        //The upper bound may just have grown loose
+        _upper[i] = std::sqrt(distance2(points[i], &_centers[id * _dims]));
+        ++distances;
+        if (_upper[i] <= bound) continue;
+        distances += assignAll(i, i + 1);
+        if (_ids[i] != id) ++changed;
+    }
+    return changed;
+}
+
+void KMeans::update()
+{
+    const std::vector<EmbedSpan>& points = *_points;
+    std::size_t n = points.size();
+
+    //Points grouped by cluster, so that each centroid is summed by one
+    //thread, in the order of its points
+    std::vector<std::size_t> first(_k + 1, 0);
+    for (int id : _ids) ++first[id + 1];
+    for (int c = 0; c < _k; ++c) first[c + 1] += first[c];
+    std::vector<std::size_t> members(n);
+    std::vector<std::size_t> at(first.begin(), first.end() - 1);
+    for (std::size_t i = 0; i < n; ++i) members[at[_ids[i]]++] = i;
+
+    std::vector<double> old(_centers);
+    std::function<void(std::size_t)> sum = [&](std::size_t c) {
+        if (first[c] == first[c + 1]) return;
+        double* center = &_centers[c * _dims];
+        std::fill(center, center + _dims, 0.0);
+        for (std::size_t m = first[c]; m < first[c + 1]; ++m) {
+            const EmbedSpan& p = points[members[m]];
+            if (const double* x = p.doubles()) {
+                for (std::size_t d = 0; d < _dims; ++d) center[d] += x[d];
+            } else {
+                for (std::size_t d = 0; d < _dims; ++d) center[d] += p[d];
+            }
+        }
+        double count = first[c + 1] - first[c];
+        for (std::size_t d = 0; d < _dims; ++d) center[d] /= count;
+    };
+    if (_pool) _pool->parallelFor(_k, sum);
+    else for (int c = 0; c < _k; ++c) sum(c);
+
+    //An emptied cluster restarts at the point farthest from its centroid
+    //(by the bounds), each at a different one
+    std::vector<bool> taken;
+    for (int c = 0; c < _k; ++c) {
+        if (first[c] != first[c + 1]) continue;
+        taken.resize(n, false);
+        std::size_t far = n;
+        for (std::size_t i = 0; i < n; ++i)
+            if (!taken[i] && (far == n || _upper[i] > _upper[far])) far = i;
+        taken[far] = true;
+        for (std::size_t d = 0; d < _dims; ++d)
+            _centers[c * _dims + d] = points[far][d];
+    }
+
+    for (int c = 0; c < _k; ++c)
+        _moved[c] = std::sqrt(_kernels->float64(&old[c * _dims],
+                                                &_centers[c * _dims], _dims));
+}
+
+double KMeans::error()
+{
+    const std::vector<EmbedSpan>& points = *_points;
+    std::vector<double> partial((points.size() + BLOCK - 1) / BLOCK, 0.0);
+    forBlocks(points.size(), [&](std::size_t begin, std::size_t end, std::size_t b) {
+        for (std::size_t i = begin; i < end; ++i)
+            partial[b] += distance2(points[i], &_centers[_ids[i] * _dims]);
+    });
+    double total = 0;
+    for (double e : partial) total += e;
+    return total;
+}
+
+int KMeans::lloyd()
+{
+    std::size_t n = _points->size();
+    std::size_t blocks = (n + BLOCK - 1) / BLOCK;
+    forBlocks(n, [&](std::size_t begin, std::size_t end, std::size_t) {
+        assignAll(begin, end);
+    });
+    _distanceCount += n * _k;
+
+    int iterations = 1;
+    for (; iterations < _maxIterations; ++iterations) {
+        update();
+
+        //Half the gap from each centroid to its nearest other: a point
+        //nearer its own centroid than that cannot be nearer another
+        std::function<void(std::size_t)> gap = [&](std::size_t c) {
+            double nearest = std::numeric_limits<double>::infinity();
+            for (int o = 0; o < _k; ++o) {
+                if ((std::size_t) o == c) continue;
+                nearest = std::min(nearest, _kernels->float64(
+                    &_centers[c * _dims], &_centers[o * _dims], _dims));
+            }
+            _half[c] = std::sqrt(nearest) / 2;
+        };
+        if (_pool) _pool->parallelFor(_k, gap);
+        else for (int c = 0; c < _k; ++c) gap(c);
+
+        //Moving the centroids loosens the bounds by as much
+        int farthest = std::max_element(_moved.begin(), _moved.end())
+            - _moved.begin();
+        double most = _moved[farthest], next = 0;
+        for (int c = 0; c < _k; ++c)
+            if (c != farthest) next = std::max(next, _moved[c]);
+        for (std::size_t i = 0; i < n; ++i) {
+            _upper[i] += _moved[_ids[i]];
+            _lower[i] -= _ids[i] == farthest ? next : most;
+        }
+
+        std::vector<std::size_t> changed(blocks, 0), distances(blocks, 0);
+        forBlocks(n, [&](std::size_t begin, std::size_t end, std::size_t b) {
+            changed[b] = assign(begin, end, distances[b]);
+        });
+        std::size_t moved = 0;
+        for (std::size_t b = 0; b < blocks; ++b) {
+            moved += changed[b];
+            _distanceCount += distances[b];
+        }
+        //The centroids are the means of the clusters as they stay
+        if (moved == 0) break;
+    }
+    return iterations;
+}
+
+int KMeans::miniBatch(unsigned seed)
+{
+    const std::vector<EmbedSpan>& points = *_points;
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<std::size_t> draw(0, points.size() - 1);
+    //Points each centroid has taken in, which sets its step
+    std::vector<std::size_t> counts(_k, 0);
+    std::vector<std::size_t> batch(_batchSize);
+    std::vector<int> batchIds(_batchSize);
+
+    int iterations = 1;
+    for (; iterations <= _maxIterations; ++iterations) {
+        for (std::size_t& i : batch) i = draw(rng);
+        forBlocks(_batchSize,
+                  [&](std::size_t begin, std::size_t end, std::size_t) {
+            double d;
+            for (std::size_t i = begin; i < end; ++i)
+                batchIds[i] = nearest(points[batch[i]], d);
+        });
+        _distanceCount += _batchSize * _k;
+
+        //Each centroid takes in its batch points in the order drawn, on
+        //one thread
+        std::vector<std::size_t> first(_k + 1, 0);
+        for (int id : batchIds) ++first[id + 1];
+        for (int c = 0; c < _k; ++c) first[c + 1] += first[c];
+        std::vector<std::size_t> members(_batchSize);
+        std::vector<std::size_t> at(first.begin(), first.end() - 1);
+        for (std::size_t i = 0; i < _batchSize; ++i)
+            members[at[batchIds[i]]++] = batch[i];
+
+        std::function<void(std::size_t)> step = [&](std::size_t c) {
+            double* center = &_centers[c * _dims];
+            std::vector<double> old(center, center + _dims);
+            for (std::size_t m = first[c]; m < first[c + 1]; ++m) {
+                const EmbedSpan& p = points[members[m]];
+                double rate = 1.0 / ++counts[c];
+                for (std::size_t d = 0; d < _dims; ++d)
+                    center[d] += rate * (p[d] - center[d]);
+            }
+            _moved[c] = std::sqrt(_kernels->float64(old.data(), center,
+                                                    _dims));
+        };
+        if (_pool) _pool->parallelFor(_k, step);
+        else for (int c = 0; c < _k; ++c) step(c);
+
+        if (*std::max_element(_moved.begin(), _moved.end()) <= _tolerance)
+            break;
+    }
+    return std::min(iterations, _maxIterations);
+}
+
+double KMeans::sampleError()
+{
+    std::vector<double> partial((_sample.size() + BLOCK - 1) / BLOCK, 0.0);
+    forBlocks(_sample.size(),
+              [&](std::size_t begin, std::size_t end, std::size_t b) {
+        double d;
+        for (std::size_t i = begin; i < end; ++i) {
+            nearest((*_points)[_sample[i]], d);
+            partial[b] += d;
+        }
+    });
+    _distanceCount += _sample.size() * _k;
+    double total = 0;
+    for (double e : partial) total += e;
+    return total;
+}
+
+bool KMeans::keep(double error, int iterations)
+{
+    if (error >= _bestError) return false;
+    _bestError = error;
+    _bestIterations = iterations;
+    _bestCentroids.assign(_k, std::vector<double>(_dims));
+    for (int c = 0; c < _k; ++c)
+        std::copy(&_centers[c * _dims], &_centers[(c + 1) * _dims],
+                  _bestCentroids[c].begin());
+    return true;
+}
+
+const std::vector<std::vector<double> >&
+KMeans::run(const std::vector<EmbedSpan>& points, int k, int npass)
+{
+    if (k < 1 || (std::size_t) k > points.size())
+        throw InvalidParamException(TRACE_INFO,
+            "KMeans - cannot make %d clusters of %u points.", k,
+            (unsigned) points.size());
+    for (const EmbedSpan& p : points)
+        OC_ASSERT(p.size() == points[0].size(),
+                  "KMeans - the points differ in size.");
+
+    std::size_t n = points.size();
+    _points = &points;
+    _dims = points[0].size();
+    _k = k;
+    _centers.resize(k * _dims);
+    _moved.resize(k);
+    _half.resize(k);
+    _bestError = std::numeric_limits<double>::infinity();
+    _distanceCount = 0;
+    _sample.clear();
+
+    if (_batchSize == 0 || _batchSize >= n) {
+        _ids.resize(n);
+        _upper.resize(n);
+        _lower.resize(n);
+        for (int pass = 0; pass < std::max(1, npass); ++pass) {
+            seed(_seed + pass);
+            int iterations = lloyd();
+            if (keep(error(), iterations)) _bestIds = _ids;
+        }
+        _points = 0;
+        return _bestCentroids;
+    }
+
+    //A few batches (and a few points per cluster) of distinct points,
+    //drawn as Floyd does, to seed and then score each pass on
+    std::size_t size = std::max(3 * _batchSize, 3 * (std::size_t) k);
+    if (size < n) {
+        std::mt19937 rng(_seed);
+        std::unordered_set<std::size_t> drawn;
+        for (std::size_t j = n - size; j < n; ++j) {
+            std::size_t i = std::uniform_int_distribution<std::size_t>(0, j)(rng);
+            drawn.insert(drawn.count(i) ? j : i);
+        }
+        _sample.assign(drawn.begin(), drawn.end());
+        std::sort(_sample.begin(), _sample.end());
+    } else {
+        for (std::size_t i = 0; i < n; ++i) _sample.push_back(i);
+    }
+    for (int pass = 0; pass < std::max(1, npass); ++pass) {
+        seed(_seed + pass);
+        int iterations = miniBatch(_seed + pass);
+        keep(sampleError(), iterations);
+    }
+
+    //Only the kept centroids have every point assigned to them
+    for (int c = 0; c < k; ++c)
+        std::copy(_bestCentroids[c].begin(), _bestCentroids[c].end(),
+                  &_centers[c * _dims]);
+    _bestIds.resize(n);
+    std::vector<double> partial((n + BLOCK - 1) / BLOCK, 0.0);
+    forBlocks(n, [&](std::size_t begin, std::size_t end, std::size_t b) {
+        double d;
+        for (std::size_t i = begin; i < end; ++i) {
+            _bestIds[i] = nearest(points[i], d);
+            partial[b] += d;
+        }
+    });
+    _distanceCount += n * k;
+    _bestError = 0;
+    for (double e : partial) _bestError += e;
+    _points = 0;
+    return _bestCentroids;
+}
@@ -0,0 +1,198 @@
+/*
+ * opencog/dimensional-embedding/KMeans.h
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_KMEANS_H
+#define _OPENCOG_KMEANS_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "EmbeddingStore.h"
+
+namespace opencog
+{
+    struct DistanceKernels;
+    class ThreadPool;
+
+    /**
+     * k-means clustering of points read in place (rows of an
+     * EmbeddingStore, in any of its forms, or any other spans).
+     *
+     * Each run is seeded with k-means++ and then follows Lloyd's
+     * iterations with Hamerly's bounds: every point keeps an upper bound
+     * on the distance to its own centroid and a lower bound on the
+     * distance to any other, both moved by how far the centroids move. A
+     * point whose bounds show its centroid is still nearest is skipped,
+     * which after the first few iterations is most of them. The
+     * assignment step runs over blocks of points, and the update step
+     * over clusters, on a thread pool if given; the results do not depend
+     * on the number of threads.
+     *
+     * For very many points there is a mini-batch mode (Sculley, "Web-scale
+     * k-means clustering"): each iteration draws a small batch of points
+     * at random and pulls every centroid toward the batch points nearest
+     * to it, by a step that shrinks as the centroid takes in more points.
+     * Seeding and comparing passes use a sample of a few batches, so only
+     * the final assignment of every point to its centroid reads them all.
+     *
+     * A clustering object can be reused; it keeps its buffers between
+     * runs.
+     */
+    class KMeans
+    {
+    public:
+        /**
+         * @param pool If given, the steps of each iteration are spread
+         * over it.
+         * @param seed Seed of the first run; run i uses seed + i.
+         */
+        explicit KMeans(ThreadPool* pool=0, unsigned seed=1);
+
+        /**
+         * Clusters points (at least k, all of one size) into k clusters,
+         * keeping the best (lowest error) of npass runs.
+         *
+         * @return The centroid of each cluster.
+         */
+        const std::vector<std::vector<double> >&
+        run(const std::vector<EmbedSpan>& points, int k, int npass=1);
+
+        /**
+         * The cluster of each point in the last run().
+         */
+        const std::vector<int>& getClusterIds() const { return _bestIds; }
+        const std::vector<std::vector<double> >& getCentroids() const
+        {
+            return _bestCentroids;
+        }
+
+        /**
+         * Sum of the squared distances of the points to their centroids.
+         */
+        double getError() const { return _bestError; }
+
+        /**
+         * Iterations the kept run took to converge.
+         */
+        int getIterations() const { return _bestIterations; }
+
+        /**
+         * Point to centroid distances the last run() computed, over all
+         * its passes.
+         */
+        std::size_t getDistanceCount() const { return _distanceCount; }
+
+        void setMaxIterations(int maxIterations)
+        {
+            _maxIterations = maxIterations;
+        }
+
+        /**
+         * Makes run() use batches of batchSize random points per
+         * iteration, until no centroid moves by more than tolerance in
+         * one. 0 (or at least as many as the points) goes back to full
+         * iterations.
+         */
+        void setMiniBatch(std::size_t batchSize, double tolerance)
+        {
+            _batchSize = batchSize;
+            _tolerance = tolerance;
+        }
+        std::size_t getBatchSize() const { return _batchSize; }
+
+        /**
+         * Points per block of the parallel steps: a run spreads over at
+         * most one thread per BLOCK points.
+         */
+        static const std::size_t BLOCK = 512;
+
+    private:
+
+        ThreadPool* _pool;
+        unsigned _seed;
+        int _maxIterations;
+        std::size_t _batchSize;
+        double _tolerance;
+        const DistanceKernels* _kernels;
+
+        //Inputs and state of the current run
+        const std::vector<EmbedSpan>* _points;
+        std::size_t _dims;
+        int _k;
+        std::vector<double> _centers;   //k rows of _dims
+        std::vector<int> _ids;
+        std::vector<double> _upper;     //to the point's own centroid
+        std::vector<double> _lower;     //to any other centroid
+        std::vector<double> _moved;     //by each centroid, last update
+        std::vector<double> _half;      //half the gap to the nearest other
+        std::vector<std::size_t> _sample; //mini-batch: seeds and scores passes
+
+        std::vector<std::vector<double> > _bestCentroids;
+        std::vector<int> _bestIds;
+        double _bestError;
+        int _bestIterations;
+        std::size_t _distanceCount;
+
+        double distance2(const EmbedSpan& p, const double* c) const;
+        /**
+         * Calls fn(begin, end, block) for the blocks of [0, n).
+         */
+        void forBlocks(std::size_t n,
+                       const std::function<void(std::size_t, std::size_t,
+                                                std::size_t)>& fn);
+        /**
+         * k-means++ over the points of _sample (or over all of them, if it
+         * is empty).
+         */
+        void seed(unsigned seed);
+        int nearest(const EmbedSpan& p, double& distance) const;
+        /**
+         * Assigns points [begin, end) to their nearest centroid from
+         * scratch, setting both bounds.
+         */
+        std::size_t assignAll(std::size_t begin, std::size_t end);
+        /**
+         * One assignment step over [begin, end) with the bounds.
+         *
+         * @return How many points changed cluster.
+         */
+        std::size_t assign(std::size_t begin, std::size_t end,
+                           std::size_t& distances);
+        void update();
+        double error();
+        /**
+         * Iterates from the seeds until no point changes cluster.
+         *
+         * @return The number of iterations.
+         */
+        int lloyd();
+        int miniBatch(unsigned seed);
+        double sampleError();
+        /**
+         * Keeps the current centroids if their error is the lowest yet.
+         */
+        bool keep(double error, int iterations);
+    };
+} //namespace
+
+#endif // _OPENCOG_KMEANS_H
@@ -0,0 +1,240 @@
+/*
+ * opencog/dimensional-embedding/KnnCache.cc
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <cmath>
+#include <iterator>
+
+#include "DistanceKernels.h"
+#include "KnnCache.h"
+
+using namespace opencog;
+
+bool KnnCache::Key::operator<(const Key& key) const
+{
+    if (linkType != key.linkType) return linkType < key.linkType;
+    if (fanin != key.fanin) return fanin < key.fanin;
+    if (k != key.k) return k < key.k;
+    return h < key.h;
+}
+
+KnnCache::KnnCache(std::size_t capacity)
+    : _capacity(capacity), _bytes(0), _hits(0), _misses(0),
+      _invalidations(0)
+{
+}
+
+KnnCache::KnnCache(const KnnCache& cache)
+    : _capacity(cache.getCapacity()), _bytes(0), _hits(0), _misses(0),
+      _invalidations(0)
+{
+}
+
+KnnCache& KnnCache::operator=(const KnnCache& cache)
+{
+    if (this != &cache) {
+        std::size_t capacity = cache.getCapacity();
+        std::lock_guard<std::mutex> lock(_mutex);
+        _capacity = capacity;
+        _entries.clear();
+        _byKey.clear();
+        _groups.clear();
+        _bytes = _hits = _misses = _invalidations = 0;
+    }
+    return *this;
+}
+
+bool KnnCache::find(const Key& key, HandleSeq& result)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::map<Key, EntryList::iterator>::iterator it = _byKey.find(key);
+    if (it == _byKey.end()) {
+        ++_misses;
+        return false;
+    }
+    ++_hits;
+    _entries.splice(_entries.begin(), _entries, it->second);
+    result = it->second->result;
+    return true;
+}
+
+void KnnCache::insert(const Key& key, const HandleSeq& result,
+                      const EmbedSpan& query, double radius)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_capacity == 0) return;
+    std::map<Key, EntryList::iterator>::iterator it = _byKey.find(key);
+    if (it != _byKey.end()) erase(it->second);
+
+    _entries.push_front(Entry(key));
+    Entry& e = _entries.front();
+    e.result = result;
+    e.query = query.toVector();
+    for (double x : e.query) e.norm += x * x;
+    e.norm = std::sqrt(e.norm);
+    e.radius = radius;
+    e.bytes = sizeof(Entry) + result.size() * sizeof(Handle)
+              + e.query.size() * sizeof(double)
+              + 8 * sizeof(void*); //the map nodes, roughly
+    Group& g = _groups[std::make_pair(key.linkType, key.fanin)];
+    if (std::isinf(radius)) {
+        e.pos = g.unbounded.insert(std::make_pair(e.norm, key));
+    } else {
+        e.pos = g.bounded.insert(std::make_pair(e.norm, key));
+        g.radii.insert(radius);
+    }
+    _byKey[key] = _entries.begin();
+    _bytes += e.bytes;
+    evict();
+}
+
+//Some slack for the rounding of compact rows and of the index's own
+//distances; dropping an answer too many is harmless
+static double slackRadius(double radius)
+{
+    return radius + 1e-4 * (1 + radius);
+}
+
+void KnnCache::pointChanged(Type l, bool fanin, const EmbedSpan& p)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::map<std::pair<Type, bool>, Group>::iterator g =
+        _groups.find(std::make_pair(l, fanin));
+    if (g == _groups.end()) return;
+    double norm = 0;
+    for (std::size_t d = 0; d < p.size(); ++d) norm += p[d] * p[d];
+    norm = std::sqrt(norm);
+
+    erase(g->second.unbounded);
+    if (g->second.radii.empty()) return;
+    //|q - p| >= ||q| - |p||, so only the answers whose norm is within the
+    //largest radius of p's can be affected
+    double widest = slackRadius(*g->second.radii.rbegin());
+    const NormMap& bounded = g->second.bounded;
+    std::vector<EntryList::iterator> affected;
+    for (NormMap::const_iterator it = bounded.lower_bound(norm - widest);
+         it != bounded.end() && it->first <= norm + widest; ++it) {
+        EntryList::iterator e = _byKey.find(it->second)->second;
+        double limit = slackRadius(e->radius);
+        if (std::abs(e->norm - norm) > limit) continue;
+        if (squared_distance(EmbedSpan(e->query), p) > limit * limit) continue;
+        affected.push_back(e);
+    }
+    for (EntryList::iterator e : affected) erase(e);
+    _invalidations += affected.size();
+}
+
+void KnnCache::clear(Type l, bool fanin)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::map<std::pair<Type, bool>, Group>::iterator g =
+        _groups.find(std::make_pair(l, fanin));
+    if (g == _groups.end()) return;
+    erase(g->second.unbounded);
+    erase(g->second.bounded);
+}
+
+void KnnCache::clear(Type l)
+{
+    clear(l, false);
+    clear(l, true);
+}
+
+void KnnCache::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _invalidations += _entries.size();
+    _entries.clear();
+    _byKey.clear();
+    _groups.clear();
+    _bytes = 0;
+}
+
+void KnnCache::setCapacity(std::size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _capacity = capacity;
+    evict();
+}
+
+std::size_t KnnCache::getCapacity() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _capacity;
+}
+
+std::size_t KnnCache::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+std::size_t KnnCache::bytes() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _bytes;
+}
+
+std::size_t KnnCache::hits() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _hits;
+}
+
+std::size_t KnnCache::misses() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _misses;
+}
+
+std::size_t KnnCache::invalidations() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _invalidations;
+}
+
+void KnnCache::erase(EntryList::iterator it)
+{
+    Group& g = _groups[std::make_pair(it->key.linkType, it->key.fanin)];
+    if (std::isinf(it->radius)) {
+        g.unbounded.erase(it->pos);
+    } else {
+        g.bounded.erase(it->pos);
+        g.radii.erase(g.radii.find(it->radius));
+    }
+    _bytes -= it->bytes;
+    _byKey.erase(it->key);
+    _entries.erase(it);
+}
+
+void KnnCache::erase(const NormMap& answers)
+{
+    //Each erase takes its answer out of the map
+    while (!answers.empty()) {
+        erase(_byKey.find(answers.begin()->second)->second);
+        ++_invalidations;
+    }
+}
+
+void KnnCache::evict()
+{
+    while (_bytes > _capacity && !_entries.empty())
+        erase(std::prev(_entries.end()));
+}
@@ -0,0 +1,170 @@
+/*
+ * opencog/dimensional-embedding/KnnCache.h
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_KNN_CACHE_H
+#define _OPENCOG_KNN_CACHE_H
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <set>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <opencog/atoms/base/Handle.h>
+
+#include "EmbeddingStore.h"
+
+namespace opencog
+{
+    /**
+     * The answers of recent kNN queries, least recently used first out
+     * once they take up more than a set number of bytes.
+     *
+     * Each answer keeps its query's coordinates and the distance of the
+     * farthest candidate its search fetched. A point of an embedding that
+     * moves (or comes or goes) can only change the answers whose query
+     * lies within that distance of it, before or after the move, and
+     * pointChanged drops exactly those; the rest stay valid. The answers
+     * of each embedding are kept sorted by their query's norm, and since
+     * |q - p| >= ||q| - |p||, pointChanged only visits those whose norm is
+     * within the largest cached distance of p's (and those that fetched
+     * every point): O(log n) plus the answers in that band, not a scan of
+     * them all.
+     *
+     * All methods may be called from several threads. A copy starts out
+     * empty, with the same capacity.
+     */
+    class KnnCache
+    {
+    public:
+        struct Key
+        {
+            Handle h;
+            Type linkType;
+            bool fanin;
+            int k;
+
+            Key(const Handle& h, Type l, bool f, int k)
+                : h(h), linkType(l), fanin(f), k(k) {}
+            bool operator<(const Key& key) const;
+        };
+
+        /**
+         * @param capacity Most bytes the answers may take; 0 turns the
+         * cache off.
+         */
+        explicit KnnCache(std::size_t capacity);
+        KnnCache(const KnnCache& cache);
+        KnnCache& operator=(const KnnCache& cache);
+
+        /**
+         * Sets result to the cached answer for key, if there is one.
+         */
+        bool find(const Key& key, HandleSeq& result);
+
+        /**
+         * Caches result for key.
+         *
+         * @param query The coordinates of key.h.
+         * @param radius No candidate the search fetched was farther from
+         * the query than this (infinity if it fetched every point).
+         */
+        void insert(const Key& key, const HandleSeq& result,
+                    const EmbedSpan& query, double radius);
+
+        /**
+         * Drops the answers for l (in direction fanin) that a point at p
+         * could be part of.
+         */
+        void pointChanged(Type l, bool fanin, const EmbedSpan& p);
+
+        /**
+         * Drops every answer for l in direction fanin.
+         */
+        void clear(Type l, bool fanin);
+
+        /**
+         * Drops every answer for l.
+         */
+        void clear(Type l);
+        void clear();
+
+        void setCapacity(std::size_t capacity);
+        std::size_t getCapacity() const;
+        std::size_t size() const;
+        std::size_t bytes() const;
+
+        std::size_t hits() const;
+        std::size_t misses() const;
+        /**
+         * How many answers pointChanged and clear have dropped.
+         */
+        std::size_t invalidations() const;
+
+    private:
+        typedef std::multimap<double, Key> NormMap;
+
+        /**
+         * The answers for one embedding (link type and direction), by the
+         * norm of their query. Those whose search fetched every point are
+         * apart, as any change can affect them.
+         */
+        struct Group
+        {
+            NormMap bounded;
+            NormMap unbounded;
+            std::multiset<double> radii; //of the bounded ones
+        };
+
+        struct Entry
+        {
+            Key key;
+            HandleSeq result;
+            std::vector<double> query;
+            double norm; //of query
+            double radius;
+            std::size_t bytes;
+            NormMap::iterator pos; //in its Group
+
+            Entry(const Key& key) : key(key), norm(0), radius(0), bytes(0) {}
+        };
+        typedef std::list<Entry> EntryList;
+
+        std::size_t _capacity;
+        EntryList _entries; //most recently used first
+        std::map<Key, EntryList::iterator> _byKey;
+        std::map<std::pair<Type, bool>, Group> _groups;
+        std::size_t _bytes;
+        std::size_t _hits;
+        std::size_t _misses;
+        std::size_t _invalidations;
+        mutable std::mutex _mutex;
+
+        void erase(EntryList::iterator it);
+        void erase(const NormMap& answers);
+        void evict();
+    };
+} //namespace
+
+#endif // _OPENCOG_KNN_CACHE_H
@@ -0,0 +1,149 @@
+/*
+ * opencog/dimensional-embedding/ThreadPool.cc
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <atomic>
+#include <exception>
+
+#include "ThreadPool.h"
+
+using namespace opencog;
+
+// Set on the pool's own threads, so that loops started from inside a loop
+// body run inline instead of waiting on workers that are all busy.
+static thread_local bool in_worker = false;
+
+struct ThreadPool::Job
+{
+    size_t n;
+    const std::function<void(size_t)>* fn;
+    std::atomic<size_t> next;
+    std::atomic<size_t> done;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    Job(size_t n_, const std::function<void(size_t)>* fn_)
+        : n(n_), fn(fn_), next(0), done(0) {}
+};
+
+ThreadPool::ThreadPool(unsigned numThreads) : _stop(false)
+{
+    if (numThreads==0) numThreads = std::thread::hardware_concurrency();
+    for (unsigned i=1; i<numThreads; ++i)
+        _workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for (std::thread& t : _workers) t.join();
+}
+
+void ThreadPool::work(Job& job)
+{
+    size_t i;
+    while ((i = job.next++) < job.n) {
+        try {
+            (*job.fn)(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            if (!job.error) job.error = std::current_exception();
+        }
+        if (++job.done == job.n) {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            job.finished.notify_all();
+        }
+    }
+}
+
+void ThreadPool::workerLoop()
+{
+    in_worker = true;
+    while (true) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [this] { return _stop || !_jobs.empty(); });
+            if (_stop) return;
+            job = _jobs.front();
+            //Once every index has been handed out nobody else needs to
+            //see the job; the threads already in it will finish it.
+            if (job->next >= job->n) {
+                _jobs.pop_front();
+                continue;
+            }
+        }
+        work(*job);
+    }
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)>& fn)
+{
+    if (n==0) return;
+    if (_workers.empty() || in_worker || n==1) {
+        for (size_t i=0; i<n; ++i) fn(i);
+        return;
+    }
+    std::shared_ptr<Job> job(new Job(n, &fn));
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.push_back(job);
+    }
+    _wake.notify_all();
+    work(*job);
+    {
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->finished.wait(lock, [&job] { return job->done == job->n; });
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (std::deque<std::shared_ptr<Job> >::iterator it = _jobs.begin();
+             it != _jobs.end(); ++it) {
+            if (*it == job) { _jobs.erase(it); break; }
+        }
+    }
+    if (job->error) std::rethrow_exception(job->error);
+}
+
+void opencog::run_concurrently(const std::function<void()>& a,
+                               const std::function<void()>& b)
+{
+    std::exception_ptr bError;
+    std::thread bThread([&]() {
+        try {
+            b();
+        } catch (...) {
+            bError = std::current_exception();
+        }
+    });
+    try {
+        a();
+    } catch (...) {
+        bThread.join();
+        throw;
+    }
+    bThread.join();
+    if (bError) std::rethrow_exception(bError);
+}
@@ -0,0 +1,94 @@
+/*
+ * opencog/dimensional-embedding/ThreadPool.h
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_DIM_EMBED_THREAD_POOL_H
+#define _OPENCOG_DIM_EMBED_THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace opencog
+{
+    /**
+     * A fixed set of worker threads for the embedding code's data-parallel
+     * loops.
+     *
+     * Several threads may call parallelFor at once; their loops share the
+     * workers. A parallelFor called from inside a worker runs inline on
+     * that worker, so nested parallel loops cannot deadlock.
+     */
+    class ThreadPool
+    {
+    public:
+        /**
+         * @param numThreads Number of threads (including the caller of
+         * parallelFor) to run loops on. 0 means one per hardware thread.
+         */
+        explicit ThreadPool(unsigned numThreads=0);
+        ~ThreadPool();
+
+        /**
+         * The number of threads a loop is spread over, counting the caller.
+         */
+        unsigned size() const { return _workers.size() + 1; }
+
+        /**
+         * Calls fn(i) for every i in [0,n) and returns once all calls are
+         * done. The calling thread takes part in the loop. If any call
+         * throws, the remaining indices are still run and the first
+         * exception is rethrown here.
+         */
+        void parallelFor(size_t n, const std::function<void(size_t)>& fn);
+
+    private:
+        struct Job;
+
+        std::vector<std::thread> _workers;
+        std::deque<std::shared_ptr<Job> > _jobs;
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        bool _stop;
+
+        ThreadPool(const ThreadPool&);
+        ThreadPool& operator=(const ThreadPool&);
+
+        void workerLoop();
+        static void work(Job& job);
+    };
+
+    /**
+     * Runs a on the calling thread and b on a thread of its own, and
+     * returns when both are done; an exception from either is rethrown.
+     * Unlike a two-way parallelFor, both halves can still start parallel
+     * loops of their own on a ThreadPool.
+     */
+    void run_concurrently(const std::function<void()>& a,
+                          const std::function<void()>& b);
+} //namespace
+
+#endif // _OPENCOG_DIM_EMBED_THREAD_POOL_H
@@ -0,0 +1,147 @@
+/*
+ * opencog/dimensional-embedding/WidestPath.cc
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <algorithm>
+#include <cmath>
+
+#include "ThreadPool.h"
+#include "WidestPath.h"
+
+using namespace opencog;
+
+// Frontier nodes handed to one parallel task; below this a relaxation
+// step is not worth splitting.
+static const std::size_t RELAX_CHUNK = 256;
+
+DeltaSteppingSearch::DeltaSteppingSearch(double delta)
+    : _delta(delta > 0 ? delta : 0.1), _round(0)
+{
+    _lightMin = std::exp(-_delta);
+}
+
+std::size_t DeltaSteppingSearch::bucketOf(double weight) const
+{
+    double b = -std::log(weight) / _delta;
+    return b > 0 ? (std::size_t) b : 0;
+}
+
+void DeltaSteppingSearch::relax(const CSRAdjacency& adj,
+                                const std::vector<uint32_t>& frontier,
+                                bool light, std::size_t current,
+                                ThreadPool& pool)
+{
+    std::size_t numChunks = (frontier.size() + RELAX_CHUNK - 1) / RELAX_CHUNK;
+    std::vector<std::vector<uint32_t> > improved(numChunks);
+    pool.parallelFor(numChunks, [&](std::size_t c) {
+        std::size_t end = std::min(frontier.size(), (c+1) * RELAX_CHUNK);
+        for (std::size_t i = c * RELAX_CHUNK; i < end; ++i) {
+            uint32_t u = frontier[i];
+            const double uWeight = _weight[u].load(std::memory_order_relaxed);
+            for (std::size_t e = adj.offsets[u]; e < adj.offsets[u+1]; ++e) {
+                const double w = adj.weights[e];
+                if ((w >= _lightMin) != light) continue;
+                const uint32_t v = adj.targets[e];
+                const double alt = uWeight * w;
+                double old = _weight[v].load(std::memory_order_relaxed);
+                while (alt > old) {
+                    if (_weight[v].compare_exchange_weak(old, alt,
+                            std::memory_order_relaxed)) {
+                        improved[c].push_back(v);
+                        break;
+                    }
+                }
+            }
+        }
+    });
+    //Requeue improved nodes; stale copies left in other buckets are
+    //dropped when those buckets come up (see takeFresh)
+    for (const std::vector<uint32_t>& chunk : improved) {
+        for (uint32_t v : chunk) {
+            std::size_t b = std::max(current,
+                bucketOf(_weight[v].load(std::memory_order_relaxed)));
+            if (b >= _buckets.size()) _buckets.resize(b+1);
+            _buckets[b].push_back(v);
+        }
+    }
+}
+
+void DeltaSteppingSearch::takeFresh(std::vector<uint32_t>& nodes,
+                                    std::size_t bucket)
+{
+    //Keep one copy of each node that still belongs in this bucket
+    if (++_round == 0) {
+        std::fill(_stamp.begin(), _stamp.end(), 0);
+        _round = 1;
+    }
+    std::size_t kept = 0;
+    for (uint32_t v : nodes) {
+        if (_stamp[v] == _round) continue;
+        if (bucketOf(_weight[v].load(std::memory_order_relaxed)) > bucket)
+            continue;
+        _stamp[v] = _round;
+        nodes[kept++] = v;
+    }
+    nodes.resize(kept);
+}
+
+const std::vector<double>& DeltaSteppingSearch::run(const CSRAdjacency& adj,
+                                                    std::size_t source,
+                                                    ThreadPool& pool)
+{
+    const std::size_t numNodes = adj.offsets.size() - 1;
+    if (_weight.size() != numNodes) {
+        std::vector<std::atomic<double> >(numNodes).swap(_weight);
+        _stamp.assign(numNodes, 0);
+        _round = 0;
+    }
+    for (std::atomic<double>& w : _weight) w.store(0.0, std::memory_order_relaxed);
+    _weight[source].store(1.0, std::memory_order_relaxed);
+    _buckets.assign(1, std::vector<uint32_t>(1, source));
+
+    std::vector<uint32_t> frontier;
+    std::vector<uint32_t> settled;
+    for (std::size_t b = 0; b < _buckets.size(); ++b) {
+        //Heavy links lead to later buckets, but rounding in bucketOf can
+        //still file the target of one under this bucket; then it is taken
+        //up again, until the heavy links leave it empty too
+        while (!_buckets[b].empty()) {
+            settled.clear();
+            //Light links can put nodes back into this bucket, so keep
+            //going until it stays empty...
+            while (!_buckets[b].empty()) {
+                frontier.clear();
+                frontier.swap(_buckets[b]);
+                takeFresh(frontier, b);
+                settled.insert(settled.end(), frontier.begin(),
+                               frontier.end());
+                relax(adj, frontier, true, b, pool);
+            }
+            //...then follow the heavy links
+            takeFresh(settled, b);
+            relax(adj, settled, false, b, pool);
+        }
+    }
+
+    _result.resize(numNodes);
+    for (std::size_t i = 0; i < numNodes; ++i)
+        _result[i] = _weight[i].load(std::memory_order_relaxed);
+    return _result;
+}
@@ -0,0 +1,141 @@
+/*
+ * opencog/dimensional-embedding/WidestPath.h
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_WIDEST_PATH_H
+#define _OPENCOG_WIDEST_PATH_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "EmbedGraph.h"
+#include "IndexedHeap.h"
+
+namespace opencog
+{
+    /**
+     * Single-source "widest path" search used to embed a pivot: the weight
+     * of a path is the product of its link weights (tv mean*confidence),
+     * and each node gets the weight of the heaviest path from the source.
+     *
+     * This is Dijkstra's algorithm with max-product in place of min-sum.
+     * It runs over the dense node ids of an EmbedGraph snapshot, the
+     * frontier is an IndexedHeap holding only nodes that have been
+     * reached, and the weights live in a flat array. A search object can
+     * be reused for any number of runs; it keeps its buffers between them.
+     */
+    class WidestPathSearch
+    {
+    public:
+        /**
+         * Runs the search from source over a CSR adjacency snapshot.
+         *
+         * @return The path weight of every node (0 for unreached nodes,
+         * 1 for the source).
+         */
+        const std::vector<double>& run(const CSRAdjacency& adj,
+                                       std::size_t source)
+        {
+            const std::size_t numNodes = adj.offsets.size() - 1;
+            _weight.assign(numNodes, 0.0);
+            _frontier.reset(numNodes);
+            _weight[source] = 1.0;
+            _frontier.push(source, 1.0);
+            const uint32_t* targets = adj.targets.data();
+            const double* weights = adj.weights.data();
+            while (!_frontier.empty()) {
+                std::size_t u = _frontier.pop();
+                const double uWeight = _weight[u];
+                const std::size_t end = adj.offsets[u+1];
+                for (std::size_t e = adj.offsets[u]; e < end; ++e) {
+                    const uint32_t v = targets[e];
+                    const double alt = uWeight * weights[e];
+                    if (alt > _weight[v]) {
+                        _weight[v] = alt;
+                        _frontier.pushOrIncrease(v, alt);
+                    }
+                }
+            }
+            return _weight;
+        }
+
+        const std::vector<double>& weights() const { return _weight; }
+
+    private:
+        IndexedHeap<double> _frontier;
+        std::vector<double> _weight;
+    };
+
+    class ThreadPool;
+
+    /**
+     * A parallel version of WidestPathSearch for graphs where a single
+     * search is too slow, using delta-stepping.
+     *
+     * Maximizing a product of weights in (0,1] is a shortest path problem
+     * over -log(weight), so nodes are put in buckets of width delta in
+     * -log space and each bucket is settled with parallel relaxations,
+     * light links (-log(w) <= delta) first and heavy ones once the
+     * bucket is done. The weights themselves are always computed as the
+     * same products the serial search computes, so the results are
+     * identical to WidestPathSearch, not just close.
+     */
+    class DeltaSteppingSearch
+    {
+    public:
+        /**
+         * @param delta Bucket width in -log(weight) space. Smaller buckets
+         * waste less work on nodes that are later improved; larger ones
+         * give each parallel step more nodes to spread over the threads.
+         */
+        explicit DeltaSteppingSearch(double delta=0.1);
+
+        /**
+         * Runs the search from source, relaxing links on pool's threads.
+         *
+         * @return The path weight of every node (0 for unreached nodes,
+         * 1 for the source).
+         */
+        const std::vector<double>& run(const CSRAdjacency& adj,
+                                       std::size_t source,
+                                       ThreadPool& pool);
+
+        const std::vector<double>& weights() const { return _result; }
+
+    private:
+        double _delta;
+        double _lightMin; //links at least this heavy are light
+        std::vector<std::atomic<double> > _weight;
+        std::vector<double> _result;
+        std::vector<std::vector<uint32_t> > _buckets;
+        std::vector<uint32_t> _stamp; //de-duplicates bucket entries
+        uint32_t _round;
+
+        std::size_t bucketOf(double weight) const;
+        void relax(const CSRAdjacency& adj,
+                   const std::vector<uint32_t>& frontier, bool light,
+                   std::size_t current, ThreadPool& pool);
+        void takeFresh(std::vector<uint32_t>& nodes, std::size_t bucket);
+    };
+} //namespace
+
+#endif // _OPENCOG_WIDEST_PATH_H
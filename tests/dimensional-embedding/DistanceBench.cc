@@ -0,0 +1,157 @@
+/*
+ * opencog/tests/dimensional-embedding/DistanceBench.cc
+ *
+ * Copyright (C) 2026 by OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Micro-benchmark of the distance kernels: times every instruction set
+ * level this CPU supports against the scalar kernels, for each storage
+ * precision, over a block of rows the size of a typical embedding; and the
+ * kernels an EmbeddingStore picks for its (padded) rows.
+ *
+ * Usage: DistanceBench [rows] [passes]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <opencog/dimensional-embedding/DistanceKernels.h>
+
+using namespace opencog;
+
+static const char* precision_name(EmbedPrecision p)
+{
+    switch (p) {
+    case EMBED_FLOAT32: return "float32";
+    case EMBED_FIXED16: return "fixed16";
+    case EMBED_QUANT8: return "quant8";
+    default: return "float64";
+    }
+}
+
+// Nanoseconds per distance of kernel k over every pair (0,r) of rows.
+static double time_kernel(const DistanceKernels& k, EmbedPrecision p,
+                          const std::vector<unsigned char>& data,
+                          const std::vector<float>& steps,
+                          size_t dims, size_t rows, int passes,
+                          double& checksum)
+{
+    const size_t rowBytes = data.size() / rows;
+    const unsigned char* base = data.data();
+    double sum = 0;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; ++pass) {
+        for (size_t r = 1; r < rows; ++r) {
+            const unsigned char* a = base;
+            const unsigned char* b = base + r * rowBytes;
+            switch (p) {
+            case EMBED_FLOAT32:
+                sum += k.float32((const float*) a, (const float*) b, dims);
+                break;
+            case EMBED_FIXED16:
+                sum += k.fixed16((const uint16_t*) a, (const uint16_t*) b, dims);
+                break;
+            case EMBED_QUANT8:
+                sum += k.quant8(a, b, steps.data(), dims);
+                break;
+            default:
+                sum += k.float64((const double*) a, (const double*) b, dims);
+            }
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    checksum = sum;
+    return elapsed.count() / (passes * (rows - 1));
+}
+
+int main(int argc, char* argv[])
+{
+    size_t rows = argc > 1 ? atoi(argv[1]) : 4096;
+    int passes = argc > 2 ? atoi(argv[2]) : 50;
+
+    const size_t dimensions[] = {8, 16, 50, 64, 128};
+    const EmbedPrecision precisions[] =
+        {EMBED_FLOAT64, EMBED_FLOAT32, EMBED_FIXED16, EMBED_QUANT8};
+    const DistanceIsa isas[] = {DIST_SSE42, DIST_AVX2, DIST_AVX512};
+    const DistanceKernels& scalar = get_distance_kernels(DIST_SCALAR);
+
+    printf("selected kernels: %s\n", distance_kernels().name);
+    printf("%-8s %5s %10s", "storage", "dims", "scalar ns");
+    for (DistanceIsa isa : isas)
+        if (cpu_supports(isa))
+            printf(" %16s", get_distance_kernels(isa).name);
+    printf(" %16s\n", "unrolled");
+
+    unsigned seed = 1;
+    for (EmbedPrecision p : precisions) {
+        for (size_t dims : dimensions) {
+            EmbeddingStore probe(dims, p);
+            std::vector<unsigned char> data(rows * probe.getRowBytes());
+            for (unsigned char& c : data) {
+                seed = seed * 1103515245 + 12345;
+                c = seed >> 16;
+            }
+            //Random bytes can make NaNs of the floating point forms
+            if (p == EMBED_FLOAT64) {
+                double* d = (double*) data.data();
+                for (size_t i = 0; i < data.size() / sizeof(double); ++i)
+                    d[i] = (i * 2654435761u % 1000) / 1000.0;
+            } else if (p == EMBED_FLOAT32) {
+                float* f = (float*) data.data();
+                for (size_t i = 0; i < data.size() / sizeof(float); ++i)
+                    f[i] = (i * 2654435761u % 1000) / 1000.0f;
+            }
+            //Zero the padding, as the store does
+            for (size_t r = 0; r < rows; ++r) {
+                unsigned char* row = &data[r * probe.getRowBytes()];
+                size_t used = probe.getRowBytes() / probe.getPaddedDimensions()
+                              * dims;
+                std::fill(row + used, row + probe.getRowBytes(), 0);
+            }
+            std::vector<float> steps(probe.getPaddedDimensions(), 1.0f / 255);
+
+            double check, ref;
+            double base = time_kernel(scalar, p, data, steps, dims, rows,
+                                      passes, ref);
+            printf("%-8s %5zu %10.2f", precision_name(p), dims, base);
+            for (DistanceIsa isa : isas) {
+                if (!cpu_supports(isa)) continue;
+                double t = time_kernel(get_distance_kernels(isa), p, data,
+                                       steps, dims, rows, passes, check);
+                printf(" %6.2f (%5.2fx)%s", t, base / t,
+                       std::abs(check - ref) > 1e-3 * ref ? "!" : " ");
+            }
+            //The kernels an EmbeddingStore of this size picks, which run
+            //over its padded rows
+            size_t padded = probe.getPaddedDimensions();
+            double t = time_kernel(distance_kernels(padded), p, data, steps,
+                                   padded, rows, passes, check);
+            printf(" %6.2f (%5.2fx)%s\n", t, base / t,
+                   &distance_kernels(padded) == &distance_kernels()
+                       ? " generic" : "");
+        }
+    }
+    return 0;
+}